@@ -0,0 +1,31 @@
+-- Tarantool instance for bench-roundtrip.R, see run-benchmarks.sh.
+--
+-- Listens on BENCH_PORT (3302 by default) so that it doesn't clash with the
+-- test instance and keeps its files in the current directory. Nothing is
+-- written to the WAL, the data is thrown away when the instance stops.
+
+box.cfg{
+    listen = tonumber(os.getenv("BENCH_PORT")) or 3302,
+    wal_mode = "none",
+}
+
+box.schema.space.create("bench", {temporary = true, if_not_exists = true})
+box.space.bench:create_index("primary", {type = "tree", parts = {1, "num"}, if_not_exists = true})
+
+box.schema.space.create("bench_insert", {temporary = true, if_not_exists = true})
+box.space.bench_insert:create_index("primary", {type = "tree", parts = {1, "num"}, if_not_exists = true})
+
+box.space.bench:truncate()
+for i = 1, 10000 do
+    box.space.bench:insert{i, "name" .. i, i * 1.5, i % 2 == 0}
+end
+
+function bench_call(a, b)
+    return a + b
+end
+
+function bench_truncate()
+    box.space.bench_insert:truncate()
+end
+
+box.schema.user.grant("guest", "read,write,execute", "universe", nil, {if_not_exists = true})
@@ -0,0 +1,18 @@
+#!/bin/sh
+#
+# Counts network syscalls made by bench-syscalls.R with the connection's
+# send and receive buffers disabled and with the default sizes. Needs
+# strace and a running test instance (see tests/testthat/init.lua).
+#
+# Usage: sh inst/benchmarks/bench-syscalls.sh
+
+dir=$(dirname "$0")
+
+for bufs in "0 0" "65536 65536"; do
+    set -- $bufs
+    echo "send_buf=$1 recv_buf=$2"
+    strace -f -c -e trace=sendto,sendmsg,writev,recvfrom,recvmsg,readv \
+        Rscript "$dir/bench-syscalls.R" "$1" "$2" 2>&1 >/dev/null | \
+        awk '/^ *[0-9.]+ +[0-9.]+/ || /total/'
+    echo
+done
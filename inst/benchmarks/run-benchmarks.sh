@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# Runs the codec micro-benchmarks and the end-to-end benchmarks against a
+# tarantool instance started from bench-instance.lua in a temporary
+# directory. Results are written as JSON files into the output directory
+# (current directory by default), named after the benchmark and the time of
+# the run, so that the runs can be compared later on.
+#
+# Usage: sh inst/benchmarks/run-benchmarks.sh [output_dir]
+
+set -e
+
+dir=$(cd "$(dirname "$0")" && pwd)
+out=${1:-.}
+stamp=$(date +%Y%m%d-%H%M%S)
+port=${BENCH_PORT:-3302}
+export BENCH_PORT=$port
+
+mkdir -p "$out"
+
+Rscript "$dir/bench-codec.R" "$out/codec-$stamp.json"
+
+work=$(mktemp -d)
+(cd "$work" && exec tarantool "$dir/bench-instance.lua") > "$work/tarantool.log" 2>&1 &
+pid=$!
+trap 'kill $pid 2>/dev/null; rm -rf "$work"' EXIT
+
+# wait for the instance to fill the space and start listening
+tries=0
+until Rscript -e "library(tarantoolr); invisible(new(Tarantool, 'localhost', $port)\$ping())" >/dev/null 2>&1; do
+    tries=$((tries + 1))
+    if [ $tries -ge 50 ]; then
+        echo "tarantool didn't start, see its log:" >&2
+        cat "$work/tarantool.log" >&2
+        exit 1
+    fi
+    sleep 0.2
+done
+
+Rscript "$dir/bench-roundtrip.R" "$out/roundtrip-$stamp.json"
+
+echo "results written to $out/codec-$stamp.json and $out/roundtrip-$stamp.json"
@@ -5,6 +5,41 @@
 
 using namespace Rcpp;
 
+// msgpack_pack
+Rcpp::RawVector msgpack_pack(SEXP x);
+RcppExport SEXP _tarantoolr_msgpack_pack(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(msgpack_pack(x));
+    return rcpp_result_gen;
+END_RCPP
+}
+// msgpack_unpack
+SEXP msgpack_unpack(Rcpp::RawVector x);
+RcppExport SEXP _tarantoolr_msgpack_unpack(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::RawVector >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(msgpack_unpack(x));
+    return rcpp_result_gen;
+END_RCPP
+}
+// msgpack_bench
+Rcpp::List msgpack_bench(SEXP x, int iterations, bool data_frame);
+RcppExport SEXP _tarantoolr_msgpack_bench(SEXP xSEXP, SEXP iterationsSEXP, SEXP data_frameSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type x(xSEXP);
+    Rcpp::traits::input_parameter< int >::type iterations(iterationsSEXP);
+    Rcpp::traits::input_parameter< bool >::type data_frame(data_frameSEXP);
+    rcpp_result_gen = Rcpp::wrap(msgpack_bench(x, iterations, data_frame));
+    return rcpp_result_gen;
+END_RCPP
+}
 // exportTarantoolConstants
 void exportTarantoolConstants();
 RcppExport SEXP _tarantoolr_exportTarantoolConstants() {
@@ -14,11 +49,51 @@ BEGIN_RCPP
     return R_NilValue;
 END_RCPP
 }
+// xlog_zstd_supported
+bool xlog_zstd_supported();
+RcppExport SEXP _tarantoolr_xlog_zstd_supported() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(xlog_zstd_supported());
+    return rcpp_result_gen;
+END_RCPP
+}
+// read_snapshot
+Rcpp::List read_snapshot(std::string path, SEXP space_filter);
+RcppExport SEXP _tarantoolr_read_snapshot(SEXP pathSEXP, SEXP space_filterSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type space_filter(space_filterSEXP);
+    rcpp_result_gen = Rcpp::wrap(read_snapshot(path, space_filter));
+    return rcpp_result_gen;
+END_RCPP
+}
+// read_xlog
+SEXP read_xlog(std::string dir, double from_lsn);
+RcppExport SEXP _tarantoolr_read_xlog(SEXP dirSEXP, SEXP from_lsnSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type dir(dirSEXP);
+    Rcpp::traits::input_parameter< double >::type from_lsn(from_lsnSEXP);
+    rcpp_result_gen = Rcpp::wrap(read_xlog(dir, from_lsn));
+    return rcpp_result_gen;
+END_RCPP
+}
 
 RcppExport SEXP _rcpp_module_boot_Tarantool();
 
 static const R_CallMethodDef CallEntries[] = {
+    {"_tarantoolr_msgpack_pack", (DL_FUNC) &_tarantoolr_msgpack_pack, 1},
+    {"_tarantoolr_msgpack_unpack", (DL_FUNC) &_tarantoolr_msgpack_unpack, 1},
+    {"_tarantoolr_msgpack_bench", (DL_FUNC) &_tarantoolr_msgpack_bench, 3},
     {"_tarantoolr_exportTarantoolConstants", (DL_FUNC) &_tarantoolr_exportTarantoolConstants, 0},
+    {"_tarantoolr_xlog_zstd_supported", (DL_FUNC) &_tarantoolr_xlog_zstd_supported, 0},
+    {"_tarantoolr_read_snapshot", (DL_FUNC) &_tarantoolr_read_snapshot, 2},
+    {"_tarantoolr_read_xlog", (DL_FUNC) &_tarantoolr_read_xlog, 2},
     {"_rcpp_module_boot_Tarantool", (DL_FUNC) &_rcpp_module_boot_Tarantool, 0},
     {NULL, NULL, 0}
 };
@@ -0,0 +1,54 @@
+#include <algorithm>
+
+#include "arena.h"
+#include "codec.h"
+
+// Zone space reserved per byte of the unpacked data: every msgpack value
+// takes at least a byte and becomes an object of sizeof(msgpack::object), the
+// values of typical tuples are a few bytes long.
+static const size_t kZoneBytesPerDataByte = 4;
+
+const size_t ReplyArena::kDefaultZoneChunk;
+const size_t ReplyArena::kMaxZoneChunk;
+
+ReplyArena::ReplyArena()
+    : zone(new msgpack::zone(kDefaultZoneChunk))
+{
+    tnt_reply_init(&current);
+}
+
+char *ReplyArena::buffer(size_t size)
+{
+    if (size > buffer_size) {
+        auto new_size = std::max(size, buffer_size * 2);
+        buf.reset(new char[new_size]);
+        buffer_size = new_size;
+    }
+
+    return (buf.get());
+}
+
+msgpack::object ReplyArena::unpack(const char *data, size_t size)
+{
+    auto needed = std::min(size * kZoneBytesPerDataByte, kMaxZoneChunk);
+    if (needed > zone_chunk) {
+        while (zone_chunk < needed) {
+            zone_chunk *= 2;
+        }
+        zone.reset(new msgpack::zone(zone_chunk));
+    } else {
+        // keeps the first chunk
+        zone->clear();
+    }
+
+    return (unpack_referenced(*zone, data, size));
+}
+
+void ReplyArena::trim()
+{
+    buf.reset();
+    buffer_size = 0;
+
+    zone_chunk = kDefaultZoneChunk;
+    zone.reset(new msgpack::zone(zone_chunk));
+}
@@ -0,0 +1,54 @@
+#ifndef TARANTOOLR_ARENA_H
+#define TARANTOOLR_ARENA_H
+
+#include <cstddef>
+#include <memory>
+
+#include <tarantool/tnt_reply.h>
+
+#include <msgpack.hpp>
+
+// Memory the replies which are converted right after they're read are kept
+// in: a reply object, a receive buffer and a zone for the unpacked msgpack
+// objects, all reused from one request to the next. The buffer grows to the
+// largest reply seen and the zone's chunk to fit the objects of the largest
+// ones (up to kMaxZoneChunk), memory is given back only by trim().
+class ReplyArena
+{
+public:
+    static const size_t kDefaultZoneChunk = 64 * 1024;
+    static const size_t kMaxZoneChunk = 4 * 1024 * 1024;
+
+    ReplyArena();
+
+    // Buffer of at least the given size, its contents is lost on the next
+    // call.
+    char *buffer(size_t size);
+
+    struct tnt_reply *reply()
+    {
+        return (&current);
+    }
+
+    // Unpacks data with the objects allocated in the arena, strings and
+    // binaries reference the data. Objects stay valid until the next call.
+    msgpack::object unpack(const char *data, size_t size);
+
+    // Shrinks the buffer and the zone back to their initial sizes.
+    void trim();
+
+    // Memory the arena holds, in bytes.
+    size_t capacity() const
+    {
+        return (buffer_size + zone_chunk);
+    }
+
+private:
+    struct tnt_reply current;
+    std::unique_ptr<char[]> buf;
+    size_t buffer_size = 0;
+    std::unique_ptr<msgpack::zone> zone;
+    size_t zone_chunk = kDefaultZoneChunk;
+};
+
+#endif
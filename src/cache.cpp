@@ -0,0 +1,109 @@
+#include <cmath>
+
+#include "cache.h"
+
+ReplyCache::ReplyCache(size_t max_entries, double default_ttl)
+    : max_entries(max_entries)
+    , default_ttl(default_ttl)
+{
+}
+
+std::string ReplyCache::make_key(
+    uint32_t space_id, uint32_t index, uint32_t limit, uint32_t offset, int iterator, const char *key, size_t key_size)
+{
+    uint32_t params[] = { space_id, index, limit, offset, static_cast<uint32_t>(iterator) };
+
+    std::string result(reinterpret_cast<const char *>(params), sizeof(params));
+    result.append(key, key_size);
+
+    return (result);
+}
+
+ReplyCache::SpaceState &ReplyCache::space(uint32_t space_id)
+{
+    auto it = spaces.find(space_id);
+    if (it == spaces.end()) {
+        SpaceState state;
+        state.ttl = default_ttl;
+        it = spaces.emplace(space_id, state).first;
+    }
+
+    return (it->second);
+}
+
+const std::string *ReplyCache::find(uint32_t space_id, const std::string &key)
+{
+    auto it = index.find(key);
+    if (it == index.end()) {
+        miss_count++;
+        return (nullptr);
+    }
+
+    auto entry = it->second;
+    if (entry->generation != space(space_id).generation || entry->expires <= Clock::now()) {
+        erase(entry);
+        miss_count++;
+        return (nullptr);
+    }
+
+    entries.splice(entries.begin(), entries, entry);
+    hit_count++;
+
+    return (&entry->data);
+}
+
+void ReplyCache::store(uint32_t space_id, std::string key, const char *data, size_t size)
+{
+    auto &state = space(space_id);
+    if (state.ttl <= 0 || max_entries == 0) {
+        return;
+    }
+
+    auto it = index.find(key);
+    if (it != index.end()) {
+        erase(it->second);
+    }
+
+    while (entries.size() >= max_entries) {
+        erase(std::prev(entries.end()));
+        eviction_count++;
+    }
+
+    Entry entry;
+    entry.key = std::move(key);
+    entry.data.assign(data, size);
+    entry.space_id = space_id;
+    entry.generation = state.generation;
+    entry.expires = std::isinf(state.ttl)
+        ? Clock::time_point::max()
+        : Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(state.ttl));
+
+    entries.push_front(std::move(entry));
+    index[entries.front().key] = entries.begin();
+}
+
+void ReplyCache::invalidate(uint32_t space_id)
+{
+    space(space_id).generation++;
+}
+
+void ReplyCache::invalidate_all()
+{
+    for (auto &it : spaces) {
+        it.second.generation++;
+    }
+}
+
+void ReplyCache::set_ttl(uint32_t space_id, double ttl)
+{
+    auto &state = space(space_id);
+    state.ttl = ttl;
+    // entries cached with the old ttl don't outlive the change
+    state.generation++;
+}
+
+void ReplyCache::erase(EntryList::iterator it)
+{
+    index.erase(it->key);
+    entries.erase(it);
+}
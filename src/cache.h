@@ -0,0 +1,94 @@
+#ifndef TARANTOOLR_CACHE_H
+#define TARANTOOLR_CACHE_H
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+// Size bounded LRU cache of select replies, kept as the raw msgpack data the
+// server sent. Entries expire after the TTL of their space and all entries of
+// a space are invalidated at once when the client writes to it: every space
+// has a generation number which is bumped on write, entries of the older
+// generations are treated as missing and dropped when looked up or evicted.
+class ReplyCache
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ReplyCache(size_t max_entries, double default_ttl);
+
+    // Key of the select request, made of everything the reply depends on.
+    static std::string make_key(uint32_t space_id, uint32_t index, uint32_t limit, uint32_t offset, int iterator, const char *key,
+        size_t key_size);
+
+    // Returns cached reply data or nullptr. Pointer stays valid until the
+    // cache is modified.
+    const std::string *find(uint32_t space_id, const std::string &key);
+
+    void store(uint32_t space_id, std::string key, const char *data, size_t size);
+
+    void invalidate(uint32_t space_id);
+
+    // Invalidates the entries of every space, for the writes which don't
+    // tell the spaces they change.
+    void invalidate_all();
+
+    // TTL of the space's entries in seconds, zero disables caching of the
+    // space.
+    void set_ttl(uint32_t space_id, double ttl);
+
+    uint64_t hits() const
+    {
+        return (hit_count);
+    }
+
+    uint64_t misses() const
+    {
+        return (miss_count);
+    }
+
+    uint64_t evictions() const
+    {
+        return (eviction_count);
+    }
+
+    size_t size() const
+    {
+        return (entries.size());
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        std::string data;
+        uint32_t space_id;
+        uint64_t generation;
+        Clock::time_point expires;
+    };
+
+    struct SpaceState {
+        uint64_t generation = 0;
+        double ttl;
+    };
+
+    using EntryList = std::list<Entry>;
+
+    size_t max_entries;
+    double default_ttl;
+
+    // most recently used entries first
+    EntryList entries;
+    std::unordered_map<std::string, EntryList::iterator> index;
+    std::unordered_map<uint32_t, SpaceState> spaces;
+
+    uint64_t hit_count = 0;
+    uint64_t miss_count = 0;
+    uint64_t eviction_count = 0;
+
+    SpaceState &space(uint32_t space_id);
+    void erase(EntryList::iterator it);
+};
+
+#endif
@@ -0,0 +1,1152 @@
+// [[Rcpp::plugins(cpp11)]]
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "codec.h"
+
+// Number of leading tuples select_df() looks at to guess the type of each column.
+static const R_xlen_t kTypeInferenceRows = 100;
+
+// Number of rows DataFrameBuilder allocates its columns for at first.
+static const R_xlen_t kInitialCapacity = 1024;
+
+// bit64 package represents NA as the smallest 64-bit integer.
+static const int64_t kNaInteger64 = std::numeric_limits<int64_t>::min();
+
+// Keys of the column maps of SQL metadata.
+static const uint64_t kSqlFieldName = 0;
+static const uint64_t kSqlFieldType = 1;
+
+// Integers doubles keep exactly are the ones not exceeding 2^53 in magnitude.
+static const int64_t kMaxExactDouble = int64_t(1) << 53;
+
+// Type of Tarantool's datetime msgpack extension.
+static const int8_t kExtDatetime = 4;
+
+static SEXP unpack_array(const msgpack::object_array &a);
+static SEXP unpack_map(const msgpack::object_map &m);
+
+void pack_elem(Rcpp::List::iterator &it, msgpack::packer<msgpack::sbuffer> &pk)
+{
+    switch (TYPEOF(*it)) {
+    case VECSXP: {
+        *it = pack_list(*it, pk);
+        break;
+    }
+    case NILSXP:
+        pk.pack_nil();
+        break;
+    case RAWSXP: {
+        SEXP v = *it;
+        if (XLENGTH(v) > std::numeric_limits<uint32_t>::max()) {
+            Rcpp::stop("raw vector is too long");
+        }
+        uint32_t size = XLENGTH(v);
+        pk.pack_bin(size);
+        pk.pack_bin_body(reinterpret_cast<const char *>(RAW(v)), size);
+        break;
+    }
+    default: {
+        SEXP v = *it;
+        VectorEncoder encoder(v);
+        if (encoder.encoding() == VectorEncoder::Encoding::Unsupported) {
+            // See https://github.com/wch/r-source/blob/e5b21d0397c607883ff25cca379687b86933d730/src/include/Rinternals.h
+            // for more details about R's internal data types
+            Rcpp::stop("unsupported R's data type: %s", sexp_type_name(v).c_str());
+        }
+        if (XLENGTH(v) != 1) {
+            Rcpp::stop("expecting a single value, got a vector of length %d", static_cast<int>(XLENGTH(v)));
+        }
+        encoder.pack(0, pk);
+    }
+    } // switch
+}
+
+Rcpp::List pack_list(Rcpp::List x, msgpack::packer<msgpack::sbuffer> &pk)
+{
+    pk.pack_array(x.size());
+
+    for (Rcpp::List::iterator it = x.begin(); it != x.end(); ++it) {
+        pack_elem(it, pk);
+    }
+
+    return (x);
+}
+
+VectorEncoder::VectorEncoder(SEXP v)
+    : data(v)
+{
+    switch (TYPEOF(v)) {
+    case LGLSXP:
+        enc = Encoding::Logical;
+        break;
+    case INTSXP:
+        // factors have internal type INTSXP too
+        if (Rf_isFactor(v)) {
+            enc = Encoding::Factor;
+            levels = Rf_getAttrib(v, R_LevelsSymbol);
+        } else {
+            enc = Encoding::Integer;
+        }
+        break;
+    case REALSXP:
+        if (is_integer64(v)) {
+            enc = Encoding::Integer64;
+        } else if (Rf_inherits(v, "Date") || Rf_inherits(v, "POSIXct")) {
+            enc = Encoding::Time;
+        } else {
+            enc = Encoding::Double;
+        }
+        break;
+    case STRSXP:
+        enc = Encoding::String;
+        break;
+    default:
+        break;
+    }
+}
+
+static void pack_charsxp(SEXP v, msgpack::packer<msgpack::sbuffer> &pk)
+{
+    if (v == NA_STRING) {
+        pk.pack_nil();
+    } else {
+        uint32_t size = LENGTH(v);
+        pk.pack_str(size);
+        pk.pack_str_body(CHAR(v), size);
+    }
+}
+
+void VectorEncoder::pack(R_xlen_t i, msgpack::packer<msgpack::sbuffer> &pk) const
+{
+    switch (enc) {
+    case Encoding::Logical: {
+        int v = LOGICAL(data)[i];
+        if (v == NA_LOGICAL) {
+            pk.pack_nil();
+        } else {
+            pk.pack(v != 0);
+        }
+        break;
+    }
+    case Encoding::Integer: {
+        int v = INTEGER(data)[i];
+        if (v == NA_INTEGER) {
+            pk.pack_nil();
+        } else {
+            pk.pack(static_cast<int64_t>(v));
+        }
+        break;
+    }
+    case Encoding::Factor: {
+        int v = INTEGER(data)[i];
+        if (v == NA_INTEGER || v < 1 || v > XLENGTH(levels)) {
+            pk.pack_nil();
+        } else {
+            pack_charsxp(STRING_ELT(levels, v - 1), pk);
+        }
+        break;
+    }
+    case Encoding::Integer64: {
+        int64_t v = integer64_value(data, i);
+        if (v == kNaInteger64) {
+            pk.pack_nil();
+        } else {
+            pk.pack(v);
+        }
+        break;
+    }
+    case Encoding::Time: {
+        double v = REAL(data)[i];
+        if (ISNAN(v)) {
+            pk.pack_nil();
+        } else if (std::trunc(v) == v && std::fabs(v) < 9.2e18) {
+            pk.pack(static_cast<int64_t>(v));
+        } else {
+            pk.pack(v);
+        }
+        break;
+    }
+    case Encoding::Double: {
+        double v = REAL(data)[i];
+        if (ISNA(v)) {
+            pk.pack_nil();
+        } else {
+            pk.pack(v);
+        }
+        break;
+    }
+    case Encoding::String:
+        pack_charsxp(STRING_ELT(data, i), pk);
+        break;
+    default:
+        Rcpp::stop("unsupported R's data type: %s", sexp_type_name(data).c_str());
+    }
+}
+
+DataFrameEncoder::DataFrameEncoder(SEXP df)
+{
+    if (!Rf_inherits(df, "data.frame")) {
+        Rcpp::stop("data.frame expected, got %s", sexp_type_name(df).c_str());
+    }
+
+    R_xlen_t ncols = XLENGTH(df);
+    if (ncols == 0) {
+        Rcpp::stop("data.frame has no columns");
+    }
+
+    columns.reserve(ncols);
+    encoders.reserve(ncols);
+    for (R_xlen_t j = 0; j < ncols; j++) {
+        SEXP column = VECTOR_ELT(df, j);
+        if (TYPEOF(column) == VECSXP) {
+            encoders.emplace_back();
+        } else {
+            encoders.emplace_back(new VectorEncoder(column));
+            if (encoders.back()->encoding() == VectorEncoder::Encoding::Unsupported) {
+                Rcpp::stop("unsupported data type of column %d: %s", static_cast<int>(j + 1), sexp_type_name(column).c_str());
+            }
+        }
+        columns.push_back(column);
+    }
+
+    rows = XLENGTH(columns[0]);
+}
+
+void DataFrameEncoder::pack_row(R_xlen_t row, msgpack::packer<msgpack::sbuffer> &pk) const
+{
+    pk.pack_array(columns.size());
+
+    for (size_t j = 0; j < columns.size(); j++) {
+        if (encoders[j]) {
+            encoders[j]->pack(row, pk);
+        } else {
+            // list column, its elements are arbitrary R objects
+            Rcpp::List elem = Rcpp::List::create(VECTOR_ELT(columns[j], row));
+            auto it = elem.begin();
+            pack_elem(it, pk);
+        }
+    }
+}
+
+KeyEncoder::KeyEncoder(SEXP keys)
+    : keys(keys)
+{
+    if (Rf_inherits(keys, "data.frame")) {
+        rows.reset(new DataFrameEncoder(keys));
+        count = rows->nrows();
+    } else if (TYPEOF(keys) == VECSXP) {
+        count = XLENGTH(keys);
+    } else if (!Rf_isNull(keys)) {
+        values.reset(new VectorEncoder(keys));
+        if (values->encoding() == VectorEncoder::Encoding::Unsupported) {
+            Rcpp::stop("unsupported data type of keys: %s", sexp_type_name(keys).c_str());
+        }
+        count = XLENGTH(keys);
+    }
+}
+
+void KeyEncoder::pack_key(R_xlen_t i, msgpack::packer<msgpack::sbuffer> &pk) const
+{
+    if (rows) {
+        rows->pack_row(i, pk);
+    } else if (values) {
+        pk.pack_array(1);
+        values->pack(i, pk);
+    } else {
+        SEXP key = VECTOR_ELT(keys, i);
+        if (Rf_isNull(key)) {
+            pk.pack_array(0);
+        } else {
+            pack_list(TYPEOF(key) == VECSXP ? Rcpp::List(key) : Rcpp::List::create(key), pk);
+        }
+    }
+}
+
+static bool reference_all(msgpack::type::object_type, std::size_t, void *)
+{
+    return (true);
+}
+
+void unpack_referenced(msgpack::unpacked &unpacked, const char *data, size_t size)
+{
+    msgpack::unpack(unpacked, data, size, reference_all);
+}
+
+msgpack::object unpack_referenced(msgpack::zone &zone, const char *data, size_t size)
+{
+    size_t off = 0;
+
+    return (msgpack::unpack(zone, data, size, off, reference_all));
+}
+
+static double integer64_bits(int64_t v)
+{
+    double bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+
+    return (bits);
+}
+
+static SEXP make_integer64(int64_t v)
+{
+    SEXP x = PROTECT(Rf_allocVector(REALSXP, 1));
+    REAL(x)[0] = integer64_bits(v);
+    Rf_setAttrib(x, R_ClassSymbol, Rf_mkString("integer64"));
+    UNPROTECT(1);
+
+    return (x);
+}
+
+static SEXP unpack_integer(int64_t v)
+{
+    // INT_MIN is NA_integer_ in R, as well as INT64_MIN is NA of integer64
+    if (v > std::numeric_limits<int>::min() && v <= std::numeric_limits<int>::max()) {
+        return (Rf_ScalarInteger(static_cast<int>(v)));
+    }
+    if ((v >= -kMaxExactDouble && v <= kMaxExactDouble) || v == kNaInteger64) {
+        return (Rf_ScalarReal(static_cast<double>(v)));
+    }
+
+    return (make_integer64(v));
+}
+
+// Tarantool's datetime is seconds since the epoch as int64, optionally
+// followed by nanoseconds as int32 and timezone data, all little endian.
+static SEXP unpack_datetime(const msgpack::object_ext &ext)
+{
+    if (ext.size != 8 && ext.size != 16) {
+        Rcpp::stop("invalid datetime value of size %d", static_cast<int>(ext.size));
+    }
+
+    auto data = reinterpret_cast<const unsigned char *>(ext.data());
+    uint64_t seconds = 0;
+    for (int i = 7; i >= 0; i--) {
+        seconds = (seconds << 8) | data[i];
+    }
+    uint32_t nsec = 0;
+    if (ext.size == 16) {
+        for (int i = 11; i >= 8; i--) {
+            nsec = (nsec << 8) | data[i];
+        }
+    }
+
+    SEXP x = PROTECT(Rf_ScalarReal(static_cast<double>(static_cast<int64_t>(seconds)) + static_cast<int32_t>(nsec) / 1e9));
+    SEXP cls = PROTECT(Rf_allocVector(STRSXP, 2));
+    SET_STRING_ELT(cls, 0, Rf_mkChar("POSIXct"));
+    SET_STRING_ELT(cls, 1, Rf_mkChar("POSIXt"));
+    Rf_setAttrib(x, R_ClassSymbol, cls);
+    UNPROTECT(2);
+
+    return (x);
+}
+
+SEXP unpack_object(const msgpack::object &obj)
+{
+    switch (obj.type) {
+    case msgpack::type::POSITIVE_INTEGER:
+        if (obj.via.u64 > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+            // doesn't fit into integer64 either
+            return (Rf_ScalarReal(static_cast<double>(obj.via.u64)));
+        }
+        return (unpack_integer(static_cast<int64_t>(obj.via.u64)));
+    case msgpack::type::NEGATIVE_INTEGER:
+        return (unpack_integer(obj.via.i64));
+    case msgpack::type::FLOAT:
+        return (Rf_ScalarReal(obj.via.f64));
+    case msgpack::type::STR:
+        return (Rf_ScalarString(Rf_mkCharLenCE(obj.via.str.ptr, obj.via.str.size, CE_UTF8)));
+    case msgpack::type::BIN: {
+        // FIXME: treat binaries as lists?
+        SEXP v = Rf_allocVector(RAWSXP, obj.via.bin.size);
+        if (obj.via.bin.size > 0) {
+            std::memcpy(RAW(v), obj.via.bin.ptr, obj.via.bin.size);
+        }
+        return (v);
+    }
+    case msgpack::type::NIL:
+        return (R_NilValue);
+    case msgpack::type::BOOLEAN:
+        return (Rf_ScalarLogical(obj.via.boolean));
+    case msgpack::type::ARRAY:
+        return (unpack_array(obj.via.array));
+    case msgpack::type::MAP:
+        return (unpack_map(obj.via.map));
+    case msgpack::type::EXT:
+        if (obj.via.ext.type() == kExtDatetime) {
+            return (unpack_datetime(obj.via.ext));
+        }
+        Rcpp::stop("unsupported msgpack extension type: %d", static_cast<int>(obj.via.ext.type()));
+    default:
+        Rcpp::stop("unsupported msgpack object: %s", msgpack_type_name(obj.type).c_str());
+    }
+}
+
+// Lists are allocated at their final length and filled in place, every
+// element is protected by its parent list as soon as it is created.
+static SEXP unpack_array(const msgpack::object_array &a)
+{
+    SEXP l = PROTECT(Rf_allocVector(VECSXP, a.size));
+
+    for (uint32_t i = 0; i < a.size; i++) {
+        SET_VECTOR_ELT(l, i, unpack_object(a.ptr[i]));
+    }
+
+    UNPROTECT(1);
+
+    return (l);
+}
+
+static SEXP unpack_map(const msgpack::object_map &m)
+{
+    // maps have always been returned ordered by key
+    std::vector<uint32_t> order(m.size);
+    for (uint32_t i = 0; i < m.size; i++) {
+        if (m.ptr[i].key.type != msgpack::type::STR) {
+            Rcpp::stop("unsupported map key: %s", msgpack_type_name(m.ptr[i].key.type).c_str());
+        }
+        order[i] = i;
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&m](uint32_t a, uint32_t b) {
+        const msgpack::object_str &x = m.ptr[a].key.via.str;
+        const msgpack::object_str &y = m.ptr[b].key.via.str;
+        int rc = std::memcmp(x.ptr, y.ptr, std::min(x.size, y.size));
+        return rc < 0 || (rc == 0 && x.size < y.size);
+    });
+
+    SEXP l = PROTECT(Rf_allocVector(VECSXP, m.size));
+    SEXP names = PROTECT(Rf_allocVector(STRSXP, m.size));
+
+    for (uint32_t i = 0; i < m.size; i++) {
+        const msgpack::object_kv &kv = m.ptr[order[i]];
+        SET_STRING_ELT(names, i, Rf_mkCharLenCE(kv.key.via.str.ptr, kv.key.via.str.size, CE_UTF8));
+        SET_VECTOR_ELT(l, i, unpack_object(kv.val));
+    }
+
+    Rf_setAttrib(l, R_NamesSymbol, names);
+    UNPROTECT(2);
+
+    return (l);
+}
+
+static DataFrameColumn::Kind column_kind(const msgpack::object &obj)
+{
+    using Kind = DataFrameColumn::Kind;
+
+    switch (obj.type) {
+    case msgpack::type::NIL:
+        return Kind::Unknown;
+    case msgpack::type::BOOLEAN:
+        return Kind::Logical;
+    case msgpack::type::POSITIVE_INTEGER:
+        if (obj.via.u64 <= static_cast<uint64_t>(std::numeric_limits<int>::max())) {
+            return Kind::Integer;
+        }
+        return obj.via.u64 <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) ? Kind::Integer64 : Kind::Double;
+    case msgpack::type::NEGATIVE_INTEGER:
+        // INT_MIN is NA_integer_ in R and INT64_MIN is NA of integer64, so they
+        // can't be stored in columns of those types
+        if (obj.via.i64 > std::numeric_limits<int>::min()) {
+            return Kind::Integer;
+        }
+        return obj.via.i64 > std::numeric_limits<int64_t>::min() ? Kind::Integer64 : Kind::Double;
+    case msgpack::type::FLOAT:
+        return Kind::Double;
+    case msgpack::type::STR:
+        return Kind::String;
+    default:
+        return Kind::List;
+    }
+}
+
+static DataFrameColumn::Kind widest_column_kind(DataFrameColumn::Kind a, DataFrameColumn::Kind b)
+{
+    using Kind = DataFrameColumn::Kind;
+
+    if (a == Kind::Unknown || a == b) {
+        return b;
+    }
+    if (b == Kind::Unknown) {
+        return a;
+    }
+
+    auto is_numeric = [](Kind k) { return k == Kind::Logical || k == Kind::Integer || k == Kind::Integer64 || k == Kind::Double; };
+    if (is_numeric(a) && is_numeric(b)) {
+        return std::max(a, b);
+    }
+
+    return Kind::List;
+}
+
+static DataFrameColumn make_column(DataFrameColumn::Kind kind, R_xlen_t nrows)
+{
+    using Kind = DataFrameColumn::Kind;
+
+    DataFrameColumn column;
+    column.kind = kind;
+
+    switch (kind) {
+    case Kind::Logical:
+        column.data = Rcpp::LogicalVector(nrows, NA_LOGICAL);
+        break;
+    case Kind::Integer:
+        column.data = Rcpp::IntegerVector(nrows, NA_INTEGER);
+        break;
+    case Kind::Integer64:
+        column.data = Rcpp::NumericVector(nrows, integer64_bits(kNaInteger64));
+        break;
+    case Kind::Double:
+        column.data = Rcpp::NumericVector(nrows, NA_REAL);
+        break;
+    case Kind::String:
+        column.data = Rcpp::CharacterVector(nrows, NA_STRING);
+        break;
+    case Kind::List:
+        column.data = Rcpp::List(nrows);
+        break;
+    default:
+        // nothing but nils so far, stays a logical NA column unless
+        // a value shows up later
+        column.data = Rcpp::LogicalVector(nrows, NA_LOGICAL);
+        break;
+    }
+
+    return (column);
+}
+
+static void widen_column(DataFrameColumn &column, DataFrameColumn::Kind kind)
+{
+    using Kind = DataFrameColumn::Kind;
+
+    SEXP from = column.data;
+    R_xlen_t nrows = XLENGTH(from);
+    DataFrameColumn widened = make_column(kind, nrows);
+
+    if (column.kind == Kind::Unknown) {
+        column = widened;
+        return;
+    }
+
+    SEXP to = widened.data;
+
+    for (R_xlen_t i = 0; i < nrows; i++) {
+        if (kind == Kind::Integer) {
+            INTEGER(to)[i] = LOGICAL(from)[i];
+        } else if (kind == Kind::Integer64) {
+            int v = column.kind == Kind::Logical ? LOGICAL(from)[i] : INTEGER(from)[i];
+            REAL(to)[i] = integer64_bits(v == NA_INTEGER ? kNaInteger64 : v);
+        } else if (kind == Kind::Double) {
+            if (column.kind == Kind::Integer64) {
+                int64_t v = integer64_value(from, i);
+                REAL(to)[i] = v == kNaInteger64 ? NA_REAL : static_cast<double>(v);
+            } else {
+                int v = column.kind == Kind::Logical ? LOGICAL(from)[i] : INTEGER(from)[i];
+                REAL(to)[i] = v == NA_INTEGER ? NA_REAL : static_cast<double>(v);
+            }
+        } else {
+            // values which were missing or nil end up as NULL list elements
+            switch (column.kind) {
+            case Kind::Logical:
+                if (LOGICAL(from)[i] != NA_LOGICAL) {
+                    SET_VECTOR_ELT(to, i, Rf_ScalarLogical(LOGICAL(from)[i]));
+                }
+                break;
+            case Kind::Integer:
+                if (INTEGER(from)[i] != NA_INTEGER) {
+                    SET_VECTOR_ELT(to, i, Rf_ScalarInteger(INTEGER(from)[i]));
+                }
+                break;
+            case Kind::Integer64:
+                if (integer64_value(from, i) != kNaInteger64) {
+                    SET_VECTOR_ELT(to, i, unpack_integer(integer64_value(from, i)));
+                }
+                break;
+            case Kind::Double:
+                if (!ISNAN(REAL(from)[i])) {
+                    SET_VECTOR_ELT(to, i, Rf_ScalarReal(REAL(from)[i]));
+                }
+                break;
+            case Kind::String:
+                if (STRING_ELT(from, i) != NA_STRING) {
+                    SET_VECTOR_ELT(to, i, Rf_ScalarString(STRING_ELT(from, i)));
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    column = widened;
+}
+
+static void set_column_value(DataFrameColumn &column, R_xlen_t row, const msgpack::object &obj)
+{
+    using Kind = DataFrameColumn::Kind;
+
+    if (obj.type == msgpack::type::NIL) {
+        // columns are NA (or NULL for lists) filled from the start
+        return;
+    }
+
+    auto kind = widest_column_kind(column.kind, column_kind(obj));
+    if (kind != column.kind) {
+        widen_column(column, kind);
+    }
+
+    SEXP data = column.data;
+
+    switch (column.kind) {
+    case Kind::Logical:
+        LOGICAL(data)[row] = obj.via.boolean;
+        break;
+    case Kind::Integer:
+        if (obj.type == msgpack::type::BOOLEAN) {
+            INTEGER(data)[row] = obj.via.boolean;
+        } else if (obj.type == msgpack::type::POSITIVE_INTEGER) {
+            INTEGER(data)[row] = static_cast<int>(obj.via.u64);
+        } else {
+            INTEGER(data)[row] = static_cast<int>(obj.via.i64);
+        }
+        break;
+    case Kind::Integer64:
+        if (obj.type == msgpack::type::BOOLEAN) {
+            REAL(data)[row] = integer64_bits(obj.via.boolean);
+        } else if (obj.type == msgpack::type::POSITIVE_INTEGER) {
+            REAL(data)[row] = integer64_bits(static_cast<int64_t>(obj.via.u64));
+        } else {
+            REAL(data)[row] = integer64_bits(obj.via.i64);
+        }
+        break;
+    case Kind::Double:
+        if (obj.type == msgpack::type::BOOLEAN) {
+            REAL(data)[row] = obj.via.boolean;
+        } else if (obj.type == msgpack::type::POSITIVE_INTEGER) {
+            REAL(data)[row] = static_cast<double>(obj.via.u64);
+        } else if (obj.type == msgpack::type::NEGATIVE_INTEGER) {
+            REAL(data)[row] = static_cast<double>(obj.via.i64);
+        } else {
+            REAL(data)[row] = obj.via.f64;
+        }
+        break;
+    case Kind::String:
+        SET_STRING_ELT(data, row, Rf_mkCharLenCE(obj.via.str.ptr, obj.via.str.size, CE_UTF8));
+        break;
+    default:
+        SET_VECTOR_ELT(data, row, unpack_object(obj));
+        break;
+    }
+}
+
+// Integer64 columns are only kept if some of their values don't fit into
+// doubles exactly.
+static void finish_integer64_column(DataFrameColumn &column)
+{
+    SEXP from = column.data;
+    R_xlen_t nrows = XLENGTH(from);
+
+    bool exact = true;
+    for (R_xlen_t i = 0; i < nrows && exact; i++) {
+        int64_t v = integer64_value(from, i);
+        exact = v == kNaInteger64 || (v >= -kMaxExactDouble && v <= kMaxExactDouble);
+    }
+
+    if (!exact) {
+        column.data.attr("class") = "integer64";
+        return;
+    }
+
+    Rcpp::NumericVector to(nrows);
+    for (R_xlen_t i = 0; i < nrows; i++) {
+        int64_t v = integer64_value(from, i);
+        to[i] = v == kNaInteger64 ? NA_REAL : static_cast<double>(v);
+    }
+
+    column.kind = DataFrameColumn::Kind::Double;
+    column.data = to;
+}
+
+static DataFrameColumn::Kind field_kind(std::string type)
+{
+    using Kind = DataFrameColumn::Kind;
+
+    // older servers spell types in upper case
+    std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+
+    if (type == "unsigned" || type == "integer" || type == "num" || type == "int") {
+        return Kind::Integer;
+    }
+    if (type == "number" || type == "double" || type == "float") {
+        return Kind::Double;
+    }
+    if (type == "string" || type == "str") {
+        return Kind::String;
+    }
+    if (type == "boolean") {
+        return Kind::Logical;
+    }
+
+    return Kind::Unknown;
+}
+
+TupleFormatPtr TupleFormat::parse(const msgpack::object &format)
+{
+    if (format.type != msgpack::type::ARRAY || format.via.array.size == 0) {
+        return (nullptr);
+    }
+
+    std::shared_ptr<TupleFormat> result(new TupleFormat());
+
+    for (uint32_t i = 0; i < format.via.array.size; i++) {
+        const msgpack::object &field = format.via.array.ptr[i];
+        std::string name;
+        std::string type;
+
+        if (field.type == msgpack::type::MAP) {
+            for (uint32_t k = 0; k < field.via.map.size; k++) {
+                const msgpack::object_kv &kv = field.via.map.ptr[k];
+                if (kv.key.type != msgpack::type::STR || kv.val.type != msgpack::type::STR) {
+                    continue;
+                }
+                std::string key(kv.key.via.str.ptr, kv.key.via.str.size);
+                if (key == "name") {
+                    name.assign(kv.val.via.str.ptr, kv.val.via.str.size);
+                } else if (key == "type") {
+                    type.assign(kv.val.via.str.ptr, kv.val.via.str.size);
+                }
+            }
+        }
+
+        result->names.push_back(name.empty() ? "V" + std::to_string(i + 1) : name);
+        result->kinds.push_back(field_kind(type));
+    }
+
+    return (result);
+}
+
+TupleFormatPtr TupleFormat::parse_sql_metadata(const msgpack::object &metadata)
+{
+    if (metadata.type != msgpack::type::ARRAY) {
+        return (nullptr);
+    }
+
+    std::shared_ptr<TupleFormat> result(new TupleFormat());
+
+    for (uint32_t i = 0; i < metadata.via.array.size; i++) {
+        const msgpack::object &column = metadata.via.array.ptr[i];
+        std::string name;
+        std::string type;
+
+        if (column.type == msgpack::type::MAP) {
+            for (uint32_t k = 0; k < column.via.map.size; k++) {
+                const msgpack::object_kv &kv = column.via.map.ptr[k];
+                if (kv.key.type != msgpack::type::POSITIVE_INTEGER || kv.val.type != msgpack::type::STR) {
+                    continue;
+                }
+                if (kv.key.via.u64 == kSqlFieldName) {
+                    name.assign(kv.val.via.str.ptr, kv.val.via.str.size);
+                } else if (kv.key.via.u64 == kSqlFieldType) {
+                    type.assign(kv.val.via.str.ptr, kv.val.via.str.size);
+                }
+            }
+        }
+
+        result->names.push_back(name.empty() ? "V" + std::to_string(i + 1) : name);
+        result->kinds.push_back(field_kind(type));
+    }
+
+    return (result);
+}
+
+static DataFrameColumn::Kind format_kind(const TupleFormat *format, size_t field)
+{
+    if (format == nullptr || field >= format->kinds.size()) {
+        return (DataFrameColumn::Kind::Unknown);
+    }
+
+    return (format->kinds[field]);
+}
+
+static SEXP make_data_frame(std::vector<DataFrameColumn> &columns, R_xlen_t nrows, const TupleFormat *format)
+{
+    for (auto &column : columns) {
+        if (column.kind == DataFrameColumn::Kind::Integer64) {
+            finish_integer64_column(column);
+        }
+    }
+
+    Rcpp::List df(columns.size());
+    Rcpp::CharacterVector names(columns.size());
+    for (size_t j = 0; j < columns.size(); j++) {
+        df[j] = columns[j].data;
+        names[j] = format != nullptr && j < format->names.size() ? format->names[j] : "V" + std::to_string(j + 1);
+    }
+
+    df.attr("names") = names;
+    df.attr("row.names") = Rcpp::IntegerVector::create(NA_INTEGER, -static_cast<int>(nrows));
+    df.attr("class") = "data.frame";
+
+    return (df);
+}
+
+SEXP unpack_data_frame(const msgpack::object &tuples, const TupleFormat *format)
+{
+    using Kind = DataFrameColumn::Kind;
+
+    if (tuples.type != msgpack::type::ARRAY && tuples.type != msgpack::type::NIL) {
+        Rcpp::stop("unexpected server reply: %s instead of an array of tuples", msgpack_type_name(tuples.type).c_str());
+    }
+
+    R_xlen_t nrows = tuples.type == msgpack::type::ARRAY ? tuples.via.array.size : 0;
+    const msgpack::object *rows = nrows > 0 ? tuples.via.array.ptr : nullptr;
+
+    for (R_xlen_t i = 0; i < nrows; i++) {
+        if (rows[i].type != msgpack::type::ARRAY) {
+            Rcpp::stop("unexpected server reply: tuple %d is %s instead of an array", static_cast<int>(i + 1),
+                msgpack_type_name(rows[i].type).c_str());
+        }
+    }
+
+    // columns of the fields the format has types for are allocated with
+    // them, types of the rest are guessed from the leading tuples, so that the
+    // whole data.frame can be allocated before the reply is decoded
+    std::vector<Kind> kinds;
+    if (format != nullptr) {
+        kinds = format->kinds;
+    }
+    for (R_xlen_t i = 0; i < std::min(nrows, kTypeInferenceRows); i++) {
+        const msgpack::object_array &fields = rows[i].via.array;
+        if (fields.size > kinds.size()) {
+            kinds.resize(fields.size, Kind::Unknown);
+        }
+        for (uint32_t j = 0; j < fields.size; j++) {
+            if (format_kind(format, j) == Kind::Unknown) {
+                kinds[j] = widest_column_kind(kinds[j], column_kind(fields.ptr[j]));
+            }
+        }
+    }
+
+    std::vector<DataFrameColumn> columns;
+    columns.reserve(kinds.size());
+    for (auto kind : kinds) {
+        columns.push_back(make_column(kind, nrows));
+    }
+
+    for (R_xlen_t i = 0; i < nrows; i++) {
+        const msgpack::object_array &fields = rows[i].via.array;
+        for (uint32_t j = 0; j < fields.size; j++) {
+            if (j >= columns.size()) {
+                // tuple is wider than any of the leading ones
+                columns.push_back(make_column(column_kind(fields.ptr[j]), nrows));
+            }
+            set_column_value(columns[j], i, fields.ptr[j]);
+        }
+    }
+
+    return (make_data_frame(columns, nrows, format));
+}
+
+// The kind is found before the column is allocated, so that it is never
+// widened on the way.
+static SEXP unpack_column(const msgpack::object_array &a)
+{
+    auto kind = DataFrameColumn::Kind::Unknown;
+    for (uint32_t i = 0; i < a.size && kind != DataFrameColumn::Kind::List; i++) {
+        kind = widest_column_kind(kind, column_kind(a.ptr[i]));
+    }
+
+    DataFrameColumn column = make_column(kind, a.size);
+    for (uint32_t i = 0; i < a.size; i++) {
+        set_column_value(column, i, a.ptr[i]);
+    }
+    if (column.kind == DataFrameColumn::Kind::Integer64) {
+        finish_integer64_column(column);
+    }
+
+    return (column.data);
+}
+
+SEXP unpack_columns(const msgpack::object &obj)
+{
+    const msgpack::object *map = &obj;
+    if (obj.type == msgpack::type::ARRAY && obj.via.array.size == 1) {
+        map = &obj.via.array.ptr[0];
+    }
+
+    if (map->type != msgpack::type::MAP) {
+        Rcpp::stop("map of columns expected, got %s", msgpack_type_name(map->type).c_str());
+    }
+
+    const msgpack::object_map &m = map->via.map;
+
+    Rcpp::List df(m.size);
+    Rcpp::CharacterVector names(m.size);
+    uint32_t nrows = 0;
+
+    for (uint32_t j = 0; j < m.size; j++) {
+        const msgpack::object_kv &kv = m.ptr[j];
+        if (kv.key.type != msgpack::type::STR) {
+            Rcpp::stop("unsupported column name: %s", msgpack_type_name(kv.key.type).c_str());
+        }
+        std::string name(kv.key.via.str.ptr, kv.key.via.str.size);
+
+        // empty Lua tables are encoded as maps
+        bool empty = kv.val.type == msgpack::type::MAP && kv.val.via.map.size == 0;
+        if (kv.val.type != msgpack::type::ARRAY && !empty) {
+            Rcpp::stop("column '%s' isn't an array: %s", name.c_str(), msgpack_type_name(kv.val.type).c_str());
+        }
+
+        uint32_t size = empty ? 0 : kv.val.via.array.size;
+        if (j == 0) {
+            nrows = size;
+        } else if (size != nrows) {
+            Rcpp::stop("column '%s' has %d values, expected %d", name.c_str(), static_cast<int>(size), static_cast<int>(nrows));
+        }
+
+        if (empty) {
+            df[j] = Rf_allocVector(LGLSXP, 0);
+        } else {
+            df[j] = unpack_column(kv.val.via.array);
+        }
+        SET_STRING_ELT(names, j, Rf_mkCharLenCE(kv.key.via.str.ptr, kv.key.via.str.size, CE_UTF8));
+    }
+
+    df.attr("names") = names;
+    df.attr("row.names") = Rcpp::IntegerVector::create(NA_INTEGER, -static_cast<int>(nrows));
+    df.attr("class") = "data.frame";
+
+    return (df);
+}
+
+DataFrameBuilder::DataFrameBuilder(R_xlen_t capacity, TupleFormatPtr format)
+    : capacity(capacity)
+    , format(format)
+{
+    if (format) {
+        for (auto kind : format->kinds) {
+            columns.push_back(make_column(kind, capacity));
+        }
+    }
+}
+
+void DataFrameBuilder::add_tuple(const msgpack::object &tuple)
+{
+    if (tuple.type != msgpack::type::ARRAY) {
+        Rcpp::stop("tuple %d is %s instead of an array", static_cast<int>(rows + 1), msgpack_type_name(tuple.type).c_str());
+    }
+
+    if (rows == capacity) {
+        grow(std::max<R_xlen_t>(capacity * 2, kInitialCapacity));
+    }
+
+    const msgpack::object_array &fields = tuple.via.array;
+    for (uint32_t j = 0; j < fields.size; j++) {
+        if (j >= columns.size()) {
+            auto kind = format_kind(format.get(), j);
+            columns.push_back(make_column(kind != DataFrameColumn::Kind::Unknown ? kind : column_kind(fields.ptr[j]), capacity));
+        }
+        set_column_value(columns[j], rows, fields.ptr[j]);
+    }
+
+    rows++;
+}
+
+SEXP DataFrameBuilder::build()
+{
+    if (rows != capacity) {
+        grow(rows);
+    }
+
+    return (make_data_frame(columns, rows, format.get()));
+}
+
+void DataFrameBuilder::grow(R_xlen_t new_capacity)
+{
+    for (auto &column : columns) {
+        // new elements are NA (or NULL for lists), just like in a fresh column
+        auto old_capacity = XLENGTH(column.data);
+        column.data = Rf_xlengthgets(column.data, new_capacity);
+        if (column.kind == DataFrameColumn::Kind::Integer64) {
+            for (R_xlen_t i = old_capacity; i < new_capacity; i++) {
+                REAL(column.data)[i] = integer64_bits(kNaInteger64);
+            }
+        }
+    }
+
+    capacity = new_capacity;
+}
+
+bool is_integer64(SEXP x)
+{
+    return (TYPEOF(x) == REALSXP && Rf_inherits(x, "integer64"));
+}
+
+int64_t integer64_value(SEXP x, R_xlen_t i)
+{
+    if (i >= XLENGTH(x)) {
+        Rcpp::stop("index out of bounds");
+    }
+
+    int64_t v;
+    std::memcpy(&v, &REAL(x)[i], sizeof(v));
+
+    return (v);
+}
+
+std::string sexp_type_name(SEXP x)
+{
+    switch (TYPEOF(x)) {
+    case NILSXP:
+        return "NILSXP";
+    case SYMSXP:
+        return "SYMSXP";
+    case LISTSXP:
+        return "LISTSXP";
+    case CLOSXP:
+        return "CLOSXP";
+    case ENVSXP:
+        return "ENVSXP";
+    case PROMSXP:
+        return "PROMSXP";
+    case LANGSXP:
+        return "LANGSXP";
+    case SPECIALSXP:
+        return "SPECIALSXP";
+    case BUILTINSXP:
+        return "BUILTINSXP";
+    case CHARSXP:
+        return "CHARSXP";
+    case LGLSXP:
+        return "LGLSXP";
+    case INTSXP:
+        return "INTSXP";
+    case REALSXP:
+        return "REALSXP";
+    case CPLXSXP:
+        return "CPLXSXP";
+    case STRSXP:
+        return "STRSXP";
+    case DOTSXP:
+        return "DOTSXP";
+    case ANYSXP:
+        return "ANYSXP";
+    case VECSXP:
+        return "VECSXP";
+    case EXPRSXP:
+        return "EXPRSXP";
+    case BCODESXP:
+        return "BCODESXP";
+    case EXTPTRSXP:
+        return "EXTPTRSXP";
+    case WEAKREFSXP:
+        return "WEAKREFSXP";
+    case S4SXP:
+        return "S4SXP";
+    case RAWSXP:
+        return "RAWSXP";
+    default:
+        return "<unknown>";
+    }
+}
+
+std::string msgpack_type_name(int type)
+{
+    switch (type) {
+    case msgpack::type::NIL:
+        return "NIL";
+    case msgpack::type::BOOLEAN:
+        return "BOOLEAN";
+    case msgpack::type::POSITIVE_INTEGER:
+        return "POSITIVE_INTEGER";
+    case msgpack::type::NEGATIVE_INTEGER:
+        return "NEGATIVE_INTEGER";
+    case msgpack::type::FLOAT:
+        return "FLOAT";
+    case msgpack::type::STR:
+        return "STR";
+    case msgpack::type::BIN:
+        return "BIN";
+    case msgpack::type::ARRAY:
+        return "ARRAY";
+    case msgpack::type::MAP:
+        return "MAP";
+    case msgpack::type::EXT:
+        return "EXT";
+    default:
+        return "<unknown>";
+    }
+}
+
+// [[Rcpp::export(".msgpack_pack")]]
+Rcpp::RawVector msgpack_pack(SEXP x)
+{
+    Rcpp::List data = TYPEOF(x) == VECSXP ? Rcpp::List(x) : Rcpp::List::create(x);
+
+    msgpack::sbuffer buff;
+    msgpack::packer<msgpack::sbuffer> pk(&buff);
+
+    pack_list(data, pk);
+
+    return (Rcpp::RawVector(buff.data(), buff.data() + buff.size()));
+}
+
+// [[Rcpp::export(".msgpack_unpack")]]
+SEXP msgpack_unpack(Rcpp::RawVector x)
+{
+    msgpack::unpacked unpacked;
+    unpack_referenced(unpacked, reinterpret_cast<const char *>(RAW(x)), x.size());
+
+    return (unpack_object(unpacked.get()));
+}
+
+// Times the codec without the overhead of calling it from R: packs x the
+// given number of times, then unpacks the result as many times, into a list
+// or, if data_frame is set, into a data.frame (x must be a list of tuples
+// then). Returns durations of the passes in nanoseconds and size of the packed
+// data in bytes.
+// [[Rcpp::export(".msgpack_bench")]]
+Rcpp::List msgpack_bench(SEXP x, int iterations, bool data_frame)
+{
+    using Clock = std::chrono::steady_clock;
+
+    if (iterations <= 0) {
+        Rcpp::stop("iterations must be a positive integer");
+    }
+
+    Rcpp::List data = TYPEOF(x) == VECSXP ? Rcpp::List(x) : Rcpp::List::create(x);
+
+    Rcpp::NumericVector pack_ns(iterations);
+    Rcpp::NumericVector unpack_ns(iterations);
+
+    msgpack::sbuffer buff;
+    msgpack::packer<msgpack::sbuffer> pk(&buff);
+
+    for (int i = 0; i < iterations; i++) {
+        buff.clear();
+        auto start = Clock::now();
+        pack_list(data, pk);
+        pack_ns[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        Rcpp::checkUserInterrupt();
+    }
+
+    for (int i = 0; i < iterations; i++) {
+        auto start = Clock::now();
+        {
+            msgpack::unpacked unpacked;
+            unpack_referenced(unpacked, buff.data(), buff.size());
+            Rcpp::RObject result = data_frame ? unpack_data_frame(unpacked.get()) : unpack_object(unpacked.get());
+        }
+        unpack_ns[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        Rcpp::checkUserInterrupt();
+    }
+
+    return (Rcpp::List::create(Rcpp::Named("pack") = pack_ns, Rcpp::Named("unpack") = unpack_ns,
+        Rcpp::Named("bytes") = static_cast<double>(buff.size())));
+}
@@ -0,0 +1,179 @@
+#ifndef TARANTOOLR_CODEC_H
+#define TARANTOOLR_CODEC_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Rcpp.h>
+
+#include <msgpack.hpp>
+
+// Conversion between R objects and their msgpack representation.
+
+Rcpp::List pack_list(Rcpp::List x, msgpack::packer<msgpack::sbuffer> &pk);
+void pack_elem(Rcpp::List::iterator &it, msgpack::packer<msgpack::sbuffer> &pk);
+
+// Atomic vector whose elements are encoded according to its type and class,
+// which are looked at once. Factors are encoded as their levels, integer64
+// (bit64 package) as 64-bit integers, Dates and POSIXct times as whole days
+// and seconds since the epoch (doubles if they have fractional part).
+// Missing values are encoded as nils.
+class VectorEncoder
+{
+public:
+    enum class Encoding { Unsupported, Logical, Integer, Factor, Double, Integer64, Time, String };
+
+    explicit VectorEncoder(SEXP v);
+
+    Encoding encoding() const
+    {
+        return (enc);
+    }
+
+    void pack(R_xlen_t i, msgpack::packer<msgpack::sbuffer> &pk) const;
+
+private:
+    SEXP data;
+    SEXP levels = R_NilValue;
+    Encoding enc = Encoding::Unsupported;
+};
+
+// Encodes rows of a data.frame as msgpack arrays reading values straight from
+// the column vectors. Column types are checked once, when encoder is created.
+// Missing values are encoded as nils.
+class DataFrameEncoder
+{
+public:
+    explicit DataFrameEncoder(SEXP df);
+
+    R_xlen_t nrows() const
+    {
+        return (rows);
+    }
+
+    void pack_row(R_xlen_t row, msgpack::packer<msgpack::sbuffer> &pk) const;
+
+private:
+    std::vector<SEXP> columns;
+    // encoders of atomic columns, list columns have none
+    std::vector<std::unique_ptr<VectorEncoder>> encoders;
+    R_xlen_t rows = 0;
+};
+
+// Encodes keys of a batch of requests as msgpack arrays: elements of an atomic
+// vector are single part keys, elements of a list are keys of their own (NULL
+// is an empty key) and rows of a data.frame are multipart keys.
+class KeyEncoder
+{
+public:
+    explicit KeyEncoder(SEXP keys);
+
+    R_xlen_t size() const
+    {
+        return (count);
+    }
+
+    void pack_key(R_xlen_t i, msgpack::packer<msgpack::sbuffer> &pk) const;
+
+private:
+    SEXP keys;
+    std::unique_ptr<DataFrameEncoder> rows;
+    std::unique_ptr<VectorEncoder> values;
+    R_xlen_t count = 0;
+};
+
+// Unpacks msgpack data with strings and binaries referencing the source buffer
+// instead of being copied into the zone of `unpacked`, so each of them is
+// copied only once, into the resulting R vector. The buffer must outlive
+// `unpacked`.
+void unpack_referenced(msgpack::unpacked &unpacked, const char *data, size_t size);
+
+// Same, with the objects allocated in the zone, which is up to the caller to
+// clear once they're converted.
+msgpack::object unpack_referenced(msgpack::zone &zone, const char *data, size_t size);
+
+// Converts msgpack object into R object: arrays and maps become (named) lists,
+// scalars become vectors of length one. Integers are returned as R integers if
+// they fit into 32 bits, as doubles if doubles keep them exactly and as
+// integer64 (bit64 package) otherwise. Datetime extension values are returned
+// as POSIXct.
+SEXP unpack_object(const msgpack::object &obj);
+
+// A column of a decoded data.frame. Starts with the type guessed from the
+// leading tuples and is widened (logical -> integer -> integer64 -> double,
+// anything else -> list) if a later value doesn't fit into it. Integer64
+// columns whose values all fit into doubles exactly become double ones when
+// the data.frame is built.
+struct DataFrameColumn {
+    enum class Kind { Unknown, Logical, Integer, Integer64, Double, String, List };
+
+    Kind kind = Kind::Unknown;
+    Rcpp::RObject data;
+};
+
+// Names and column types of the fields of a space's tuples, made out of the
+// space format. Columns of the fields with a type are created with it instead
+// of the guessed one and named after the fields. Fields of types which don't
+// map to an R vector type (any, scalar, array etc.) are guessed as usual.
+struct TupleFormat {
+    std::vector<std::string> names;
+    std::vector<DataFrameColumn::Kind> kinds;
+
+    // Format is the format field of a _space tuple: array of maps with
+    // "name" and "type" keys.
+    static std::shared_ptr<const TupleFormat> parse(const msgpack::object &format);
+
+    // Metadata of the result of an SQL statement: array of maps with the
+    // column name under key 0 and its type under key 1.
+    static std::shared_ptr<const TupleFormat> parse_sql_metadata(const msgpack::object &metadata);
+};
+
+using TupleFormatPtr = std::shared_ptr<const TupleFormat>;
+
+// Converts an array of tuples into a data.frame with a column per field.
+SEXP unpack_data_frame(const msgpack::object &tuples, const TupleFormat *format = nullptr);
+
+// Converts a map of columns, {name = {values...}, ...}, into a data.frame
+// with the columns in the order of the map. Every array becomes a single
+// vector typed the way a column of tuples would be. The map can also be
+// given as the data of a call or eval reply, an array holding just it.
+SEXP unpack_columns(const msgpack::object &obj);
+
+// Builds a data.frame out of tuples added one at a time, for when the number
+// of rows isn't known upfront. Columns grow geometrically and are trimmed to
+// the actual number of rows by build().
+class DataFrameBuilder
+{
+public:
+    explicit DataFrameBuilder(R_xlen_t capacity = 0, TupleFormatPtr format = nullptr);
+
+    void add_tuple(const msgpack::object &tuple);
+
+    R_xlen_t nrows() const
+    {
+        return (rows);
+    }
+
+    SEXP build();
+
+private:
+    void grow(R_xlen_t new_capacity);
+
+    std::vector<DataFrameColumn> columns;
+    R_xlen_t rows = 0;
+    R_xlen_t capacity = 0;
+    TupleFormatPtr format;
+};
+
+// Checks whether x is a bit64's integer64 vector, which keeps 64-bit integers
+// in the bits of doubles.
+bool is_integer64(SEXP x);
+
+// The i-th element of integer64 vector x.
+int64_t integer64_value(SEXP x, R_xlen_t i = 0);
+
+std::string sexp_type_name(SEXP x);
+std::string msgpack_type_name(int type);
+
+#endif
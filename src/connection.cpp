@@ -0,0 +1,519 @@
+#include <poll.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+#include <tarantool/tnt_buf.h>
+#include <tarantool/tnt_mem.h>
+
+#include <msgpuck.h>
+
+#include "connection.h"
+
+static struct timeval to_timeval(double seconds)
+{
+    struct timeval tv;
+    tv.tv_sec = static_cast<time_t>(seconds);
+    tv.tv_usec = static_cast<suseconds_t>((seconds - tv.tv_sec) * 1e6);
+
+    return (tv);
+}
+
+ConnectionOptions ConnectionOptions::parse(const Rcpp::List &options)
+{
+    ConnectionOptions result;
+
+    if (options.containsElementNamed("send_buf")) {
+        result.send_buf = Rcpp::as<size_t>(options["send_buf"]);
+    }
+
+    if (options.containsElementNamed("recv_buf")) {
+        result.recv_buf = Rcpp::as<size_t>(options["recv_buf"]);
+    }
+
+    if (options.containsElementNamed("timeout")) {
+        result.timeout = Rcpp::as<double>(options["timeout"]);
+    }
+
+    if (options.containsElementNamed("connect_timeout")) {
+        result.connect_timeout = Rcpp::as<double>(options["connect_timeout"]);
+    }
+
+    return (result);
+}
+
+Connection::Connection(
+    std::string host, int port, std::string user, std::string password, const ConnectionOptions &options, bool load_schema)
+{
+    stream = TntStreamPtr(tnt_net(nullptr));
+    auto uri = mk_connect_uri(host, port, user, password);
+
+    {
+        auto err = tnt_error(stream.get());
+        if (err != TNT_EOK) {
+            Rcpp::stop(mk_error_msg());
+        }
+    }
+
+    {
+        auto err = tnt_set(stream.get(), TNT_OPT_URI, uri.c_str());
+        if (err != TNT_EOK) {
+            Rcpp::stop(mk_error_msg());
+        }
+
+        // requests are accumulated in the send buffer until flushed, replies
+        // are read in chunks of the receive buffer size, zero disables them
+        tnt_set(stream.get(), TNT_OPT_SEND_BUF, options.send_buf);
+        tnt_set(stream.get(), TNT_OPT_RECV_BUF, options.recv_buf);
+
+        if (options.connect_timeout > 0) {
+            auto tv = to_timeval(options.connect_timeout);
+            tnt_set(stream.get(), TNT_OPT_TMOUT_CONNECT, &tv);
+        }
+
+        // replies are waited for with a deadline by read_reply(), polling
+        // the socket, so the timeout can be changed at any moment. It isn't
+        // set as a socket timeout, which is applied once, on connect, and
+        // would break blocking reads after the timeout is raised.
+        set_timeout(options.timeout);
+
+        err = tnt_connect(stream.get());
+        if (err != TNT_EOK) {
+            Rcpp::stop(mk_error_msg());
+        }
+
+        if (load_schema) {
+            err = tnt_reload_schema(stream.get());
+            if (err != TNT_EOK) {
+                Rcpp::stop(mk_error_msg());
+            }
+        }
+    }
+}
+
+std::string Connection::mk_error_msg()
+{
+    std::string msg = std::string("tarantool: ") + std::string(tnt_strerror(stream.get()));
+    return (msg);
+}
+
+bool Connection::broken()
+{
+    return (tnt_error(stream.get()) != TNT_EOK);
+}
+
+void Connection::reconnect()
+{
+    stashed_replies.clear();
+    discarded_replies.clear();
+    sql_statements.clear();
+    dropped_sql_statements.clear();
+    session++;
+
+    // tnt_connect() starts sync ids from zero again, they are kept growing
+    // instead, so that the requests of the new session don't take the ids of
+    // the old ones, which futures etc. may still wait for
+    auto reqid = stream->reqid;
+    auto err = tnt_connect(stream.get());
+    stream->reqid = std::max(stream->reqid, reqid);
+    if (err != TNT_EOK) {
+        Rcpp::stop(mk_error_msg());
+    }
+}
+
+std::string Connection::mk_connect_uri(std::string host, int port, std::string user, std::string password)
+{
+    std::stringstream ss;
+
+    if (!user.empty()) {
+        ss << user;
+    }
+
+    if (!password.empty()) {
+        ss << ":" << password;
+    }
+
+    if (!ss.str().empty()) {
+        ss << "@";
+    }
+
+    if (!host.empty() && port > 0) {
+        ss << host << ":" << port;
+    }
+
+    return ss.str();
+}
+
+int Connection::get_space_id(SEXP space)
+{
+    int space_id = -1;
+
+    auto t = TYPEOF(space);
+    if (t == STRSXP) {
+        auto s = Rcpp::as<std::string>(space);
+        space_id = find_space_id(s);
+        if (space_id == -1) {
+            Rcpp::stop("space '%s' doesn't exist.", s.c_str());
+        }
+    } else if (t == INTSXP || t == REALSXP) {
+        space_id = Rcpp::as<int>(space);
+    } else {
+        Rcpp::stop("space must be an integer or a string");
+    }
+
+    return space_id;
+}
+
+// Names are reloaded lazily, when the schema is known to have changed or the
+// space isn't found. Reloading is only possible with no requests in flight,
+// otherwise names known so far are used.
+int Connection::find_space_id(const std::string &name)
+{
+    NestedRequest nested(metrics);
+
+    if (schema_stale && tnt_reload_schema(stream.get()) == 0) {
+        schema_stale = false;
+    }
+
+    auto space_id = tnt_get_spaceno(stream.get(), name.c_str(), name.size());
+    if (space_id == -1 && tnt_reload_schema(stream.get()) == 0) {
+        schema_stale = false;
+        space_id = tnt_get_spaceno(stream.get(), name.c_str(), name.size());
+    }
+
+    return (space_id);
+}
+
+void Connection::check_schema_id(const TntReply *reply)
+{
+    if (reply->schema_id == 0 || reply->schema_id == schema_id) {
+        return;
+    }
+
+    if (schema_id != 0) {
+        schema_stale = true;
+        formats.clear();
+    }
+    schema_id = reply->schema_id;
+}
+
+TupleFormatPtr Connection::tuple_format(uint32_t space_id)
+{
+    auto it = formats.find(space_id);
+    if (it != formats.end()) {
+        return (it->second);
+    }
+
+    msgpack::sbuffer buff;
+    msgpack::packer<msgpack::sbuffer> pk(&buff);
+    pk.pack_array(1);
+    pk.pack(space_id);
+
+    auto key = TntStreamPtr(tnt_object_as(NULL, const_cast<char *>(buff.data()), buff.size()));
+
+    NestedRequest nested(metrics);
+
+    auto sync = next_sync();
+    auto rc = tnt_select(stream.get(), tnt_vsp_space, 0, 1, 0, TNT_ITER_EQ, key.get());
+    check_tnt_api_rc(rc, "tnt_select()");
+    flush();
+
+    auto reply = read_reply(sync);
+    if (reply->code != 0) {
+        Rcpp::stop(reply_error_msg(reply.get()));
+    }
+
+    // _vspace tuple is [id, owner, name, engine, field_count, flags, format]
+    static const uint32_t kFormatField = 6;
+
+    TupleFormatPtr format;
+    if (reply->data && reply->data_end) {
+        msgpack::unpacked unpacked;
+        unpack_referenced(unpacked, reply->data, reply->data_end - reply->data);
+        const msgpack::object &tuples = unpacked.get();
+        if (tuples.type == msgpack::type::ARRAY && tuples.via.array.size > 0) {
+            const msgpack::object &tuple = tuples.via.array.ptr[0];
+            if (tuple.type == msgpack::type::ARRAY && tuple.via.array.size > kFormatField) {
+                format = TupleFormat::parse(tuple.via.array.ptr[kFormatField]);
+            }
+        }
+    }
+
+    // the reply may have shown a schema change, which dropped the formats
+    formats[space_id] = format;
+
+    return (format);
+}
+
+// Reads the next reply into the arena, the way tnt_net's read_reply() does
+// into memory it allocates.
+TntReply *Connection::read_arena_reply()
+{
+    if (stream->wrcnt == 0) {
+        Rcpp::stop("read_reply() failed: no replies pending");
+    }
+    stream->wrcnt--;
+
+    char header[TNT_REPLY_IPROTO_HDR_SIZE];
+    if (stream->read(stream.get(), header, sizeof(header)) == -1) {
+        Rcpp::stop("read_reply() failed: %s", tnt_strerror(stream.get()));
+    }
+
+    const char *p = header;
+    if (mp_typeof(*p) != MP_UINT) {
+        Rcpp::stop("read_reply() failed: invalid reply length");
+    }
+    size_t size = mp_decode_uint(&p);
+
+    auto buf = arena.buffer(size);
+    if (stream->read(stream.get(), buf, size) == -1) {
+        Rcpp::stop("read_reply() failed: %s", tnt_strerror(stream.get()));
+    }
+
+    auto reply = arena.reply();
+    tnt_reply_init(reply);
+    reply->buf = buf;
+    reply->buf_size = size;
+
+    size_t header_size = 0;
+    if (tnt_reply_hdr0(reply, buf, size, &header_size) != 0
+        || (header_size < size && tnt_reply_body0(reply, buf + header_size, size - header_size, NULL) != 0)) {
+        Rcpp::stop("read_reply() failed: malformed reply");
+    }
+
+    check_schema_id(reply);
+
+    return (reply);
+}
+
+// Copies reply out of the arena, so that it can be kept.
+static TntReplyPtr copy_reply(const TntReply *reply)
+{
+    auto copy = TntReplyPtr(tnt_reply_init(NULL));
+    if (!copy) {
+        Rcpp::stop("couldn't init tnt_reply object");
+    }
+
+    auto buf = static_cast<char *>(tnt_mem_alloc(reply->buf_size));
+    if (buf == nullptr && reply->buf_size > 0) {
+        Rcpp::stop("couldn't allocate %d bytes for reply", static_cast<int>(reply->buf_size));
+    }
+    std::memcpy(buf, reply->buf, reply->buf_size);
+
+    auto rebase = [&](const char *p) -> const char * { return (p ? buf + (p - reply->buf) : nullptr); };
+
+    *copy = *reply;
+    copy->alloc = 1;
+    copy->buf = buf;
+    copy->error = rebase(reply->error);
+    copy->error_end = rebase(reply->error_end);
+    copy->data = rebase(reply->data);
+    copy->data_end = rebase(reply->data_end);
+
+    return (copy);
+}
+
+// With a timeout the reply is waited for by polling, which stashes it.
+void Connection::wait_for(uint64_t sync)
+{
+    if (timeout_ms >= 0 && !wait_reply(sync, timeout_ms)) {
+        discard_reply(sync);
+        Rcpp::stop("request timed out after %g seconds", timeout());
+    }
+}
+
+TntReplyPtr Connection::read_reply(uint64_t sync)
+{
+    wait_for(sync);
+
+    auto it = stashed_replies.find(sync);
+    if (it != stashed_replies.end()) {
+        auto reply = std::move(it->second);
+        stashed_replies.erase(it);
+        metrics.mark_replied(reply.get());
+        return (reply);
+    }
+
+    while (true) {
+        auto reply = read_arena_reply();
+        if (reply->sync == sync) {
+            metrics.mark_replied(reply);
+            return (copy_reply(reply));
+        }
+        stash_reply(reply);
+    }
+}
+
+const TntReply *Connection::read_reply_view(uint64_t sync)
+{
+    wait_for(sync);
+
+    held_reply.reset();
+
+    auto it = stashed_replies.find(sync);
+    if (it != stashed_replies.end()) {
+        held_reply = std::move(it->second);
+        stashed_replies.erase(it);
+        metrics.mark_replied(held_reply.get());
+        return (held_reply.get());
+    }
+
+    while (true) {
+        auto reply = read_arena_reply();
+        if (reply->sync == sync) {
+            metrics.mark_replied(reply);
+            return (reply);
+        }
+        stash_reply(reply);
+    }
+}
+
+bool Connection::wait_reply(uint64_t sync, int timeout_ms)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout_ms, 0));
+
+    while (!has_reply(sync)) {
+        int left = -1;
+        if (timeout_ms >= 0) {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            left = static_cast<int>(std::max(0LL, static_cast<long long>(ms)));
+        }
+        // nothing received means the time is up or nothing is in flight
+        if (poll_replies(left) == 0) {
+            return (false);
+        }
+    }
+
+    return (true);
+}
+
+void Connection::stash_reply(const TntReply *reply)
+{
+    if (discarded_replies.erase(reply->sync) == 0) {
+        stashed_replies[reply->sync] = copy_reply(reply);
+    }
+}
+
+int Connection::poll_replies(int timeout_ms)
+{
+    // poll in short slices, so that the wait can be interrupted from R
+    static const int kPollSliceMs = 100;
+
+    auto sn = TNT_SNET_CAST(stream.get());
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout_ms, 0));
+    int received = 0;
+
+    while (stream->wrcnt > 0) {
+        // replies which are already in the receive buffer are taken first
+        bool ready = sn->rbuf.buf != nullptr && sn->rbuf.top > sn->rbuf.off;
+
+        while (!ready) {
+            // once something was received only what is already there is taken
+            int wait = 0;
+            if (received == 0) {
+                wait = kPollSliceMs;
+                if (timeout_ms >= 0) {
+                    long long left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                    wait = static_cast<int>(std::max(0LL, std::min(left, static_cast<long long>(kPollSliceMs))));
+                }
+            }
+
+            struct pollfd pfd;
+            pfd.fd = sn->fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+
+            auto rc = poll(&pfd, 1, wait);
+            if (rc == -1 && errno != EINTR) {
+                Rcpp::stop("poll() failed: %s", strerror(errno));
+            }
+            if (rc > 0) {
+                ready = true;
+                break;
+            }
+            if (wait == 0 || (timeout_ms >= 0 && std::chrono::steady_clock::now() >= deadline)) {
+                return (received);
+            }
+            Rcpp::checkUserInterrupt();
+        }
+
+        // the reply may still be incomplete, the rest of it is waited for
+        stash_reply(read_arena_reply());
+        received++;
+    }
+
+    return (received);
+}
+
+void Connection::drain_replies()
+{
+    while (stream->wrcnt > 0) {
+        if (poll_replies(timeout_ms) == 0 && timeout_ms >= 0) {
+            Rcpp::stop("request timed out after %g seconds", timeout());
+        }
+    }
+}
+
+void Connection::discard_reply(uint64_t sync)
+{
+    if (stashed_replies.erase(sync) == 0) {
+        discarded_replies.insert(sync);
+    }
+}
+
+void Connection::write_requests(TntStreamPtr &requests)
+{
+    auto count = requests->wrcnt;
+    if (count == 0) {
+        return;
+    }
+
+    auto rc = stream->write(stream.get(), TNT_SBUF_DATA(requests.get()), TNT_SBUF_SIZE(requests.get()));
+    if (rc == -1) {
+        Rcpp::stop(mk_error_msg());
+    }
+
+    // write() accounted the whole buffer as a single request, but the server
+    // sends a reply for every request in it.
+    stream->wrcnt += count - 1;
+
+    flush();
+}
+
+void Connection::flush()
+{
+    metrics.mark_sent();
+
+    auto rc = tnt_flush(stream.get());
+    check_tnt_api_rc(rc, "tnt_flush()");
+}
+
+void Connection::reset_stats()
+{
+    metrics.reset();
+
+    auto sn = TNT_SNET_CAST(stream.get());
+    bytes_sent_base = sn->bytes_sent;
+    bytes_received_base = sn->bytes_received;
+}
+
+std::string reply_error_msg(const TntReply *reply)
+{
+    std::string err_msg;
+    if (reply->error && reply->error_end) {
+        err_msg = std::string(reply->error, reply->error_end - reply->error);
+    }
+
+    return (err_msg);
+}
+
+void check_tnt_api_rc(int rc, const char *function_name)
+{
+    if (rc == -1) {
+        Rcpp::stop("'%s' function failed.", function_name);
+    }
+}
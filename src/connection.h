@@ -0,0 +1,255 @@
+#ifndef TARANTOOLR_CONNECTION_H
+#define TARANTOOLR_CONNECTION_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <Rcpp.h>
+
+#include <tarantool/tarantool.h>
+#include <tarantool/tnt_net.h>
+#include <tarantool/tnt_opt.h>
+
+#include "arena.h"
+#include "cache.h"
+#include "codec.h"
+#include "metrics.h"
+
+using TntStream = struct tnt_stream;
+using TntReply = struct tnt_reply;
+
+class TntStreamDeleter
+{
+public:
+    void operator()(TntStream *s)
+    {
+        tnt_stream_free(s);
+    }
+};
+
+class TntReplyDeleter
+{
+public:
+    void operator()(TntReply *r)
+    {
+        tnt_reply_free(r);
+        // free(r);
+    }
+};
+
+using TntStreamPtr = std::unique_ptr<TntStream, TntStreamDeleter>;
+using TntReplyPtr = std::unique_ptr<TntReply, TntReplyDeleter>;
+using TntStreamRawPtr = TntStream *;
+
+// Settings of a connection given in the options of the objects opening one.
+// Timeouts are in seconds, negative values mean no timeout.
+struct ConnectionOptions {
+    // sizes of the send and receive buffers, large enough to hold a pipelined
+    // batch of small requests or a bunch of replies to them
+    size_t send_buf = 64 * 1024;
+    size_t recv_buf = 64 * 1024;
+    double timeout = -1;
+    double connect_timeout = -1;
+
+    // Reads send_buf, recv_buf, timeout and connect_timeout entries of the
+    // options, the ones which are missing keep their defaults.
+    static ConnectionOptions parse(const Rcpp::List &options);
+};
+
+// SQL statement prepared on the server.
+struct SqlStatement {
+    uint64_t id;
+    uint32_t bind_count;
+    // prepared statement objects using it, it's unprepared when the last of
+    // them is
+    uint32_t users;
+};
+
+// Network connection to the tarantool server. It's shared between Tarantool
+// object and auxiliary objects created by it (pipelines etc.), so the socket
+// stays open for as long as any of them is alive.
+class Connection
+{
+public:
+    Connection(std::string host, int port, std::string user, std::string password, const ConnectionOptions &options,
+        bool load_schema = true);
+
+    TntStreamPtr stream;
+
+    std::string mk_error_msg();
+
+    // Connection is broken when the stream failed on the client side (I/O
+    // errors etc.), errors reported by the server don't count.
+    bool broken();
+
+    // Reestablishes connection, replies to the requests which were in flight
+    // are lost.
+    void reconnect();
+
+    int get_space_id(SEXP space);
+
+    // Format of the space's tuples, null if the space has none. Formats are
+    // fetched from _vspace when first asked for and dropped when replies show
+    // that the schema has changed since.
+    TupleFormatPtr tuple_format(uint32_t space_id);
+
+    // Sync id the next request sent through the stream gets.
+    uint64_t next_sync() const
+    {
+        return (stream->reqid);
+    }
+
+    // Reads reply to the request with the given sync id. Replies to other
+    // requests arriving before it are kept until they are asked for, so
+    // several requests can be in flight at once. Only I/O errors and timeouts
+    // are reported, it's up to the caller to check reply code. The reply to a
+    // request which timed out is dropped when it arrives, the connection stays
+    // usable.
+    TntReplyPtr read_reply(uint64_t sync);
+
+    // Same as read_reply(), but the reply is read into the arena instead of
+    // being allocated. It stays valid until the next reply is read.
+    const TntReply *read_reply_view(uint64_t sync);
+
+    // Waits up to timeout_ms milliseconds (negative value means forever) for
+    // the reply to the request with the given sync id without taking it.
+    // Returns whether it has arrived.
+    bool wait_reply(uint64_t sync, int timeout_ms);
+
+    // Time the replies are waited for by read_reply(), in seconds (negative
+    // value means forever).
+    double timeout() const
+    {
+        return (timeout_ms < 0 ? -1 : timeout_ms / 1000.0);
+    }
+
+    void set_timeout(double seconds)
+    {
+        timeout_ms = seconds < 0 ? -1 : static_cast<int>(seconds * 1000);
+    }
+
+    int fd() const
+    {
+        return (TNT_SNET_CAST(stream.get())->fd);
+    }
+
+    // Waits up to timeout_ms milliseconds (negative value means forever) for
+    // replies to the requests in flight and keeps the ones which arrived.
+    // Returns number of replies received.
+    int poll_replies(int timeout_ms);
+
+    // Reads the replies to all the requests in flight, waiting for them up to
+    // the timeout, so that the stream can be read directly (multi_select()
+    // workers). The ones which weren't discarded are kept.
+    void drain_replies();
+
+    // Checks whether reply to the request with the given sync id was already
+    // received.
+    bool has_reply(uint64_t sync) const
+    {
+        return (stashed_replies.count(sync) > 0);
+    }
+
+    // Reply to the request with the given sync id won't be asked for, it's
+    // dropped when (or if already) received.
+    void discard_reply(uint64_t sync);
+
+    // Sends the requests written to the stream.
+    void flush();
+
+    // Sends requests accumulated in the memory stream (see tnt_buf()) with a
+    // single write and accounts them as pending replies.
+    void write_requests(TntStreamPtr &requests);
+
+    // SQL statements prepared through the connection, by their text. They
+    // belong to the session, so they are forgotten when it's reconnected.
+    std::unordered_map<std::string, SqlStatement> sql_statements;
+
+    // Ids of the statements nobody uses anymore, they are unprepared along
+    // with the next SQL request rather than when garbage collected.
+    std::vector<uint64_t> dropped_sql_statements;
+
+    // Number of times the connection was reestablished, what belongs to the
+    // session (prepared statements) is stale once it changes.
+    uint64_t session = 0;
+
+    // Cache of select replies, null unless enabled.
+    std::unique_ptr<ReplyCache> cache;
+
+    // Drops cached replies from the space written to through the connection.
+    void invalidate_cache(uint32_t space_id)
+    {
+        if (cache) {
+            cache->invalidate(space_id);
+        }
+    }
+
+    // Drops all cached replies, for the requests which may have written to
+    // any space (SQL statements etc.).
+    void invalidate_cache()
+    {
+        if (cache) {
+            cache->invalidate_all();
+        }
+    }
+
+    RequestMetrics metrics;
+
+    // Memory of the replies read by read_reply_view() and of their unpacked
+    // data.
+    ReplyArena arena;
+
+    // Gives the memory the arena has grown to back.
+    void trim_arena()
+    {
+        held_reply.reset();
+        arena.trim();
+    }
+
+    // Traffic since the connection was opened or the statistics were reset.
+    uint64_t bytes_sent() const
+    {
+        return (TNT_SNET_CAST(stream.get())->bytes_sent - bytes_sent_base);
+    }
+
+    uint64_t bytes_received() const
+    {
+        return (TNT_SNET_CAST(stream.get())->bytes_received - bytes_received_base);
+    }
+
+    void reset_stats();
+
+private:
+    std::unordered_map<uint64_t, TntReplyPtr> stashed_replies;
+    std::unordered_set<uint64_t> discarded_replies;
+    uint64_t bytes_sent_base = 0;
+    uint64_t bytes_received_base = 0;
+    int timeout_ms = -1;
+
+    // schema version of the last reply, names of spaces and formats loaded
+    // before it changed are reloaded when needed
+    uint64_t schema_id = 0;
+    bool schema_stale = false;
+    std::unordered_map<uint32_t, TupleFormatPtr> formats;
+
+    // stashed reply returned by read_reply_view()
+    TntReplyPtr held_reply;
+
+    void check_schema_id(const TntReply *reply);
+    void wait_for(uint64_t sync);
+    TntReply *read_arena_reply();
+    int find_space_id(const std::string &name);
+
+    void stash_reply(const TntReply *reply);
+    std::string mk_connect_uri(std::string host, int port, std::string user, std::string password);
+};
+
+using ConnectionPtr = std::shared_ptr<Connection>;
+
+std::string reply_error_msg(const TntReply *reply);
+void check_tnt_api_rc(int rc, const char *function_name);
+
+#endif
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cmath>
+
+#include "metrics.h"
+
+Histogram::Histogram()
+{
+    reset();
+}
+
+int Histogram::bucket_index(uint64_t value)
+{
+    if (value < static_cast<uint64_t>(kSubBuckets)) {
+        return (static_cast<int>(value));
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - kSubBucketBits;
+
+    return (((shift + 1) << kSubBucketBits) + static_cast<int>((value >> shift) & (kSubBuckets - 1)));
+}
+
+uint64_t Histogram::bucket_max(int index)
+{
+    if (index < kSubBuckets) {
+        return (index);
+    }
+
+    int shift = (index >> kSubBucketBits) - 1;
+    uint64_t mantissa = static_cast<uint64_t>((index & (kSubBuckets - 1)) | kSubBuckets);
+
+    return (((mantissa + 1) << shift) - 1);
+}
+
+void Histogram::record(uint64_t value)
+{
+    buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    total_count.fetch_add(1, std::memory_order_relaxed);
+    total_sum.fetch_add(value, std::memory_order_relaxed);
+
+    auto current = max_value.load(std::memory_order_relaxed);
+    while (value > current && !max_value.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void Histogram::reset()
+{
+    for (auto &bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    total_count.store(0, std::memory_order_relaxed);
+    total_sum.store(0, std::memory_order_relaxed);
+    max_value.store(0, std::memory_order_relaxed);
+}
+
+double Histogram::mean() const
+{
+    auto n = count();
+
+    return (n == 0 ? 0 : static_cast<double>(total_sum.load(std::memory_order_relaxed)) / n);
+}
+
+uint64_t Histogram::quantile(double q) const
+{
+    auto n = count();
+    if (n == 0) {
+        return (0);
+    }
+
+    auto rank = static_cast<uint64_t>(std::ceil(q * n));
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return (std::min(bucket_max(i), max()));
+        }
+    }
+
+    return (max());
+}
+
+const char *RequestMetrics::op_name(Op op)
+{
+    static const char *names[] = { "ping", "insert", "replace", "select", "delete", "update", "upsert", "call", "eval", "execute" };
+
+    return (names[op]);
+}
+
+const char *RequestMetrics::phase_name(Phase phase)
+{
+    static const char *names[] = { "encode", "wait", "decode" };
+
+    return (names[phase]);
+}
+
+RequestMetrics::OpMetrics &RequestMetrics::metrics(Op op)
+{
+    if (!ops[op]) {
+        ops[op].reset(new OpMetrics());
+    }
+
+    return (*ops[op]);
+}
+
+void RequestMetrics::begin(Op op)
+{
+    active = true;
+    current = op;
+    was_sent = false;
+    was_replied = false;
+    started = Clock::now();
+}
+
+void RequestMetrics::mark_sent()
+{
+    if (active && !was_sent) {
+        sent = Clock::now();
+        was_sent = true;
+    }
+}
+
+void RequestMetrics::mark_replied(const struct tnt_reply *reply)
+{
+    if (!active || !was_sent) {
+        return;
+    }
+
+    // every reply to the requests pipelined by update_many() and the like is
+    // accounted, they are timed until the last one
+    replied = Clock::now();
+    was_replied = true;
+
+    auto &m = metrics(current);
+    m.reply_size.record(reply->buf_size);
+    if (reply->code != 0) {
+        m.errors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void RequestMetrics::end()
+{
+    if (!active) {
+        return;
+    }
+    active = false;
+
+    if (!was_replied) {
+        // request failed on the way to the server or while its reply was
+        // read, the ones which weren't sent (served from the cache, rejected
+        // arguments) aren't accounted at all
+        if (was_sent) {
+            metrics(current).errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    auto ns = [](Clock::duration d) { return (static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count())); };
+
+    auto &m = metrics(current);
+    m.latency[Encode].record(ns(sent - started));
+    m.latency[Wait].record(ns(replied - sent));
+    m.latency[Decode].record(ns(Clock::now() - replied));
+}
+
+void RequestMetrics::pause()
+{
+    if (!active) {
+        return;
+    }
+
+    active = false;
+    paused = true;
+    paused_at = Clock::now();
+}
+
+void RequestMetrics::resume()
+{
+    if (!paused) {
+        return;
+    }
+
+    // the moments marked so far are moved forward by the pause, so that it
+    // isn't counted in the phase it fell into
+    auto pause = Clock::now() - paused_at;
+    started += pause;
+    sent += pause;
+    replied += pause;
+
+    paused = false;
+    active = true;
+}
+
+void RequestMetrics::reset()
+{
+    for (auto &op : ops) {
+        op.reset();
+    }
+}
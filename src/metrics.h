@@ -0,0 +1,161 @@
+#ifndef TARANTOOLR_METRICS_H
+#define TARANTOOLR_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include <tarantool/tnt_reply.h>
+
+// Histogram of non-negative values with buckets of logarithmic width: every
+// power of two range is split into kSubBuckets linear buckets, so values are
+// kept with relative error under 1/kSubBuckets whatever their magnitude, in a
+// fixed amount of memory (the scheme HdrHistogram uses). Counters are atomic,
+// recording doesn't take locks.
+class Histogram
+{
+public:
+    static const int kSubBucketBits = 4;
+    static const int kSubBuckets = 1 << kSubBucketBits;
+    static const int kBuckets = (64 - kSubBucketBits + 1) << kSubBucketBits;
+
+    Histogram();
+
+    void record(uint64_t value);
+    void reset();
+
+    uint64_t count() const
+    {
+        return (total_count.load(std::memory_order_relaxed));
+    }
+
+    uint64_t max() const
+    {
+        return (max_value.load(std::memory_order_relaxed));
+    }
+
+    double mean() const;
+
+    // Value at the given quantile (0..1), reported as the highest value of its
+    // bucket.
+    uint64_t quantile(double q) const;
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> buckets;
+    std::atomic<uint64_t> total_count;
+    std::atomic<uint64_t> total_sum;
+    std::atomic<uint64_t> max_value;
+
+    static int bucket_index(uint64_t value);
+    static uint64_t bucket_max(int index);
+};
+
+// Instrumentation of the requests sent through a connection. Latency of the
+// synchronous requests is split into phases: encoding (packing arguments and
+// building the request), network wait (from the moment the request is
+// flushed to the socket until its reply is read) and decoding of the reply to
+// R objects. Requests are timed with RequestTimer, the connection marks the
+// moments the request is sent and its reply is read.
+class RequestMetrics
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum Op { Ping, Insert, Replace, Select, Delete, Update, Upsert, Call, Eval, Execute, kOpCount };
+    enum Phase { Encode, Wait, Decode, kPhaseCount };
+
+    struct OpMetrics {
+        std::array<Histogram, kPhaseCount> latency;
+        Histogram reply_size;
+        std::atomic<uint64_t> errors{ 0 };
+    };
+
+    static const char *op_name(Op op);
+    static const char *phase_name(Phase phase);
+
+    // Metrics of the operation, null if it wasn't performed since the last
+    // reset.
+    const OpMetrics *get(Op op) const
+    {
+        return (ops[op].get());
+    }
+
+    void begin(Op op);
+    void mark_sent();
+    void mark_replied(const struct tnt_reply *reply);
+    void end();
+
+    // Suspend timing of the request for the time of the requests it makes
+    // itself (fetches of the schema etc.), which aren't accounted at all.
+    void pause();
+    void resume();
+
+    void reset();
+
+private:
+    // histograms are allocated on first use of the operation, most
+    // connections only do a few kinds of requests
+    std::array<std::unique_ptr<OpMetrics>, kOpCount> ops;
+
+    // state of the request being timed
+    bool active = false;
+    Op current = Ping;
+    Clock::time_point started;
+    Clock::time_point sent;
+    Clock::time_point replied;
+    bool was_sent = false;
+    bool was_replied = false;
+    bool paused = false;
+    Clock::time_point paused_at;
+
+    OpMetrics &metrics(Op op);
+};
+
+// Keeps a nested request out of the metrics of the request being timed for as
+// long as it's in scope.
+class NestedRequest
+{
+public:
+    explicit NestedRequest(RequestMetrics &metrics)
+        : metrics(metrics)
+    {
+        metrics.pause();
+    }
+
+    ~NestedRequest()
+    {
+        metrics.resume();
+    }
+
+    NestedRequest(const NestedRequest &) = delete;
+    NestedRequest &operator=(const NestedRequest &) = delete;
+
+private:
+    RequestMetrics &metrics;
+};
+
+// Times the request for as long as it's in scope.
+class RequestTimer
+{
+public:
+    RequestTimer(RequestMetrics &metrics, RequestMetrics::Op op)
+        : metrics(metrics)
+    {
+        metrics.begin(op);
+    }
+
+    ~RequestTimer()
+    {
+        metrics.end();
+    }
+
+    RequestTimer(const RequestTimer &) = delete;
+    RequestTimer &operator=(const RequestTimer &) = delete;
+
+private:
+    RequestMetrics &metrics;
+};
+
+#endif
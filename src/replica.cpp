@@ -0,0 +1,368 @@
+#include <poll.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <random>
+
+#include <tarantool/tnt_io.h>
+
+#include "codec.h"
+#include "replica.h"
+
+// Request types and keys of the replication protocol which aren't used by
+// the rest of the client.
+static const uint32_t kRequestOk = 0;
+static const uint32_t kRequestSubscribe = 66;
+static const uint32_t kRequestErrorBit = 0x8000;
+static const uint32_t kKeyReplicaAnon = 0x50;
+static const uint32_t kSchemaSpaceId = 272;
+
+// Size of the packet length prefix, which is always encoded as msgpack uint32.
+static const size_t kLengthPrefixSize = 5;
+
+// Seconds between the acks unless told otherwise, half of the default
+// replication_timeout of the server.
+static const double kDefaultAckInterval = 0.5;
+
+static bool is_dml(uint32_t type)
+{
+    return (type == TNT_OP_INSERT || type == TNT_OP_REPLACE || type == TNT_OP_UPDATE || type == TNT_OP_DELETE
+        || type == TNT_OP_UPSERT);
+}
+
+// Replica which isn't registered with the server subscribes under a random
+// uuid.
+static std::string random_uuid()
+{
+    std::random_device rd;
+    std::mt19937_64 gen(rd());
+    std::uniform_int_distribution<int> nibble(0, 15);
+
+    std::string uuid = "xxxxxxxx-xxxx-4xxx-yxxx-xxxxxxxxxxxx";
+    for (auto &c : uuid) {
+        if (c == 'x' || c == 'y') {
+            int v = nibble(gen);
+            if (c == 'y') {
+                v = 8 | (v & 3);
+            }
+            c = "0123456789abcdef"[v];
+        }
+    }
+
+    return (uuid);
+}
+
+TarantoolReplica::TarantoolReplica(ConnectionPtr conn, Rcpp::List options)
+    : conn(conn)
+{
+    double from_lsn = 0;
+    double ack_seconds = kDefaultAckInterval;
+    std::string uuid;
+
+    if (options.containsElementNamed("from_lsn")) {
+        from_lsn = Rcpp::as<double>(options["from_lsn"]);
+    }
+    if (options.containsElementNamed("server_id")) {
+        server_id = Rcpp::as<int>(options["server_id"]);
+    }
+    if (options.containsElementNamed("uuid")) {
+        uuid = Rcpp::as<std::string>(options["uuid"]);
+    }
+    if (options.containsElementNamed("ack_interval")) {
+        ack_seconds = Rcpp::as<double>(options["ack_interval"]);
+        if (!(ack_seconds > 0)) {
+            Rcpp::stop("ack_interval must be positive");
+        }
+    }
+    ack_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(ack_seconds));
+    if (options.containsElementNamed("spaces")) {
+        SEXP filter = options["spaces"];
+        if (TYPEOF(filter) == STRSXP) {
+            Rcpp::CharacterVector names(filter);
+            for (R_xlen_t i = 0; i < names.size(); i++) {
+                spaces.insert(conn->get_space_id(Rcpp::wrap(Rcpp::as<std::string>(names[i]))));
+            }
+        } else if (!Rf_isNull(filter)) {
+            for (int id : Rcpp::as<Rcpp::IntegerVector>(filter)) {
+                spaces.insert(id);
+            }
+        }
+    }
+
+    // server sends the requests following the ones in the vclock
+    if (from_lsn > 1) {
+        vclock[server_id] = static_cast<uint64_t>(from_lsn) - 1;
+    }
+
+    bool anonymous = uuid.empty();
+    if (anonymous) {
+        uuid = random_uuid();
+    }
+
+    subscribe(uuid, fetch_cluster_uuid(), anonymous);
+}
+
+std::string TarantoolReplica::fetch_cluster_uuid()
+{
+    msgpack::sbuffer buff;
+    msgpack::packer<msgpack::sbuffer> pk(&buff);
+    pk.pack_array(1);
+    pk.pack(std::string("cluster"));
+
+    auto key = TntStreamPtr(tnt_object_as(NULL, const_cast<char *>(buff.data()), buff.size()));
+
+    auto sync = conn->next_sync();
+    auto rc = tnt_select(conn->stream.get(), kSchemaSpaceId, 0, 1, 0, TNT_ITER_EQ, key.get());
+    check_tnt_api_rc(rc, "tnt_select()");
+
+    conn->flush();
+
+    auto reply = conn->read_reply(sync);
+    if (reply->code != 0) {
+        Rcpp::stop(reply_error_msg(reply.get()));
+    }
+
+    msgpack::unpacked unpacked;
+    if (reply->data && reply->data_end) {
+        unpack_referenced(unpacked, reply->data, reply->data_end - reply->data);
+    }
+
+    // _schema tuple is ['cluster', uuid]
+    const msgpack::object &tuples = unpacked.get();
+    if (tuples.type != msgpack::type::ARRAY || tuples.via.array.size == 0 || tuples.via.array.ptr[0].type != msgpack::type::ARRAY
+        || tuples.via.array.ptr[0].via.array.size < 2 || tuples.via.array.ptr[0].via.array.ptr[1].type != msgpack::type::STR) {
+        Rcpp::stop("couldn't get uuid of the cluster");
+    }
+
+    const msgpack::object_str &uuid = tuples.via.array.ptr[0].via.array.ptr[1].via.str;
+
+    return (std::string(uuid.ptr, uuid.size));
+}
+
+void TarantoolReplica::subscribe(const std::string &uuid, const std::string &cluster_uuid, bool anonymous)
+{
+    msgpack::sbuffer header;
+    msgpack::packer<msgpack::sbuffer> hpk(&header);
+    hpk.pack_map(2);
+    hpk.pack(static_cast<uint32_t>(TNT_CODE));
+    hpk.pack(kRequestSubscribe);
+    hpk.pack(static_cast<uint32_t>(TNT_SYNC));
+    hpk.pack(conn->next_sync());
+    conn->stream->reqid++;
+
+    msgpack::sbuffer body;
+    msgpack::packer<msgpack::sbuffer> pk(&body);
+    pk.pack_map(anonymous ? 4 : 3);
+    pk.pack(static_cast<uint32_t>(TNT_SERVER_UUID));
+    pk.pack(uuid);
+    pk.pack(static_cast<uint32_t>(TNT_CLUSTER_UUID));
+    pk.pack(cluster_uuid);
+    pk.pack(static_cast<uint32_t>(TNT_VCLOCK));
+    pk.pack(vclock);
+    if (anonymous) {
+        pk.pack(kKeyReplicaAnon);
+        pk.pack(true);
+    }
+
+    send_packet(header, body);
+}
+
+// Newer servers expect the replica to report its vclock from time to time and
+// drop the ones which keep silent.
+void TarantoolReplica::send_ack()
+{
+    msgpack::sbuffer header;
+    msgpack::packer<msgpack::sbuffer> hpk(&header);
+    hpk.pack_map(1);
+    hpk.pack(static_cast<uint32_t>(TNT_CODE));
+    hpk.pack(kRequestOk);
+
+    msgpack::sbuffer body;
+    msgpack::packer<msgpack::sbuffer> pk(&body);
+    pk.pack_map(1);
+    pk.pack(static_cast<uint32_t>(TNT_VCLOCK));
+    pk.pack(vclock);
+
+    send_packet(header, body);
+
+    next_ack = std::chrono::steady_clock::now() + ack_interval;
+}
+
+void TarantoolReplica::send_packet(const msgpack::sbuffer &header, const msgpack::sbuffer &body)
+{
+    uint32_t len = header.size() + body.size();
+
+    packet.resize(kLengthPrefixSize);
+    packet[0] = static_cast<char>(0xce);
+    for (int i = 0; i < 4; i++) {
+        packet[1 + i] = static_cast<char>((len >> (24 - 8 * i)) & 0xff);
+    }
+    packet.insert(packet.end(), header.data(), header.data() + header.size());
+    packet.insert(packet.end(), body.data(), body.data() + body.size());
+
+    auto rc = conn->stream->write(conn->stream.get(), packet.data(), packet.size());
+    if (rc == -1) {
+        stream_failed();
+    }
+
+    conn->flush();
+}
+
+void TarantoolReplica::stream_failed()
+{
+    closed = true;
+
+    Rcpp::stop("replication stream is broken (%s), start a new replica from lsn() + 1 to resume it", conn->mk_error_msg().c_str());
+}
+
+bool TarantoolReplica::wait_readable(int timeout_ms)
+{
+    // poll in short slices, so that the wait can be interrupted from R
+    static const int kPollSliceMs = 100;
+
+    auto sn = TNT_SNET_CAST(conn->stream.get());
+    if (sn->rbuf.buf != nullptr && sn->rbuf.top > sn->rbuf.off) {
+        return (true);
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout_ms, 0));
+
+    while (true) {
+        long long left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        int wait = static_cast<int>(std::max(0LL, std::min(left, static_cast<long long>(kPollSliceMs))));
+
+        struct pollfd pfd;
+        pfd.fd = sn->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        auto rc = poll(&pfd, 1, wait);
+        if (rc == -1 && errno != EINTR) {
+            Rcpp::stop("poll() failed: %s", strerror(errno));
+        }
+        if (rc > 0) {
+            return (true);
+        }
+        if (left <= 0) {
+            return (false);
+        }
+        Rcpp::checkUserInterrupt();
+    }
+}
+
+void TarantoolReplica::read_packet()
+{
+    auto sn = TNT_SNET_CAST(conn->stream.get());
+
+    char prefix[kLengthPrefixSize];
+    if (tnt_io_recv(sn, prefix, sizeof(prefix)) == -1) {
+        stream_failed();
+    }
+    if (static_cast<unsigned char>(prefix[0]) != 0xce) {
+        Rcpp::stop("unexpected data in the replication stream");
+    }
+
+    uint32_t len = 0;
+    for (size_t i = 1; i < kLengthPrefixSize; i++) {
+        len = (len << 8) | static_cast<unsigned char>(prefix[i]);
+    }
+
+    packet.resize(len);
+    if (len > 0 && tnt_io_recv(sn, packet.data(), len) == -1) {
+        stream_failed();
+    }
+}
+
+void TarantoolReplica::check_error_row(const XrowRequest &row)
+{
+    if ((row.type & kRequestErrorBit) == 0) {
+        return;
+    }
+
+    // error message is the only thing in the body
+    std::string message = "replication stream failed";
+
+    msgpack::unpacked header;
+    msgpack::unpacked body;
+    std::size_t off = 0;
+    msgpack::unpack(header, packet.data(), packet.size(), off);
+    if (off < packet.size()) {
+        msgpack::unpack(body, packet.data(), packet.size(), off);
+        const msgpack::object &obj = body.get();
+        if (obj.type == msgpack::type::MAP) {
+            for (uint32_t i = 0; i < obj.via.map.size; i++) {
+                const msgpack::object_kv &kv = obj.via.map.ptr[i];
+                if (kv.key.type == msgpack::type::POSITIVE_INTEGER && kv.key.via.u64 == TNT_ERROR && kv.val.type == msgpack::type::STR) {
+                    message = std::string(kv.val.via.str.ptr, kv.val.via.str.size);
+                }
+            }
+        }
+    }
+
+    closed = true;
+
+    Rcpp::stop(message);
+}
+
+SEXP TarantoolReplica::fetch(int max_events, double timeout)
+{
+    if (closed) {
+        Rcpp::stop("replication stream is broken, start a new replica from lsn() + 1 to resume it");
+    }
+
+    XrowFrameBuilder frame;
+    XrowRequest row;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<long long>(timeout * 1e6));
+
+    while (frame.nrows() < max_events) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_ack) {
+            send_ack();
+        }
+
+        // once there are events to return only what already arrived is
+        // taken, otherwise the wait is cut short when the next ack is due
+        int wait = 0;
+        if (frame.nrows() == 0) {
+            auto until = std::min(deadline, next_ack);
+            long long left = std::chrono::duration_cast<std::chrono::milliseconds>(until - now).count();
+            wait = static_cast<int>(std::max(0LL, left));
+        }
+        if (!wait_readable(wait)) {
+            if (frame.nrows() > 0 || std::chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+            continue;
+        }
+
+        read_packet();
+
+        const char *data = packet.data();
+        decode_xrow(&data, packet.data() + packet.size(), row);
+        check_error_row(row);
+
+        if (row.lsn > 0 && row.lsn > vclock[row.server_id]) {
+            vclock[row.server_id] = row.lsn;
+        }
+
+        if (row.type == kRequestOk || !is_dml(row.type)) {
+            // subscription reply, heartbeat or a request nobody is interested in
+            continue;
+        }
+        if (spaces.empty() || spaces.count(row.space_id) > 0) {
+            frame.add(row);
+        }
+    }
+
+    return (frame.build());
+}
+
+double TarantoolReplica::lsn() const
+{
+    auto it = vclock.find(server_id);
+
+    return (it == vclock.end() ? 0 : static_cast<double>(it->second));
+}
@@ -0,0 +1,61 @@
+#ifndef TARANTOOLR_REPLICA_H
+#define TARANTOOLR_REPLICA_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <Rcpp.h>
+
+#include "connection.h"
+#include "xlog.h"
+
+// Consumer of the server's replication stream. It subscribes to the server the
+// way a replica does and turns the data modification requests it's sent into
+// data.frames of events. Requests to spaces it isn't interested in are skipped
+// without their tuples being decoded.
+//
+// The replica's vclock is acknowledged every ack_interval seconds (0.5 unless
+// given in the options, half of the server's default replication_timeout)
+// while fetch() waits, otherwise the server considers the replica dead and
+// drops it. Once the stream is broken fetch() fails, a new replica started
+// from lsn() + 1 resumes it.
+class TarantoolReplica
+{
+public:
+    TarantoolReplica(ConnectionPtr conn, Rcpp::List options);
+
+    // Waits up to `timeout` seconds for events and returns the ones received,
+    // at most `max_events` of them, as a data.frame of the read_xlog() format.
+    // Stops with an error if the server closed the stream.
+    SEXP fetch(int max_events, double timeout);
+
+    // Lsn of the last request received from the server the stream was
+    // started for, so that the stream can be resumed later on.
+    double lsn() const;
+
+private:
+    ConnectionPtr conn;
+    std::unordered_set<uint32_t> spaces;
+    uint32_t server_id = 1;
+    std::map<uint32_t, uint64_t> vclock;
+    std::vector<char> packet;
+
+    std::chrono::steady_clock::duration ack_interval;
+    std::chrono::steady_clock::time_point next_ack;
+    bool closed = false;
+
+    std::string fetch_cluster_uuid();
+    void subscribe(const std::string &uuid, const std::string &cluster_uuid, bool anonymous);
+    void send_ack();
+    void send_packet(const msgpack::sbuffer &header, const msgpack::sbuffer &body);
+    [[noreturn]] void stream_failed();
+    bool wait_readable(int timeout_ms);
+    void read_packet();
+    void check_error_row(const XrowRequest &row);
+};
+
+#endif
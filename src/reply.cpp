@@ -0,0 +1,172 @@
+// [[Rcpp::plugins(cpp11)]]
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <msgpuck.h>
+
+#include "reply.h"
+
+TarantoolReply::TarantoolReply(TntReplyPtr reply, TupleFormatPtr format)
+    : reply(std::move(reply))
+    , format(format)
+{
+    if (this->reply->data && this->reply->data_end) {
+        init(this->reply->data, this->reply->data_end);
+    }
+}
+
+TarantoolReply::TarantoolReply(const char *data, size_t size, TupleFormatPtr format)
+    : copy(data, size)
+    , format(format)
+{
+    if (size > 0) {
+        init(copy.data(), copy.data() + copy.size());
+    }
+}
+
+void TarantoolReply::init(const char *begin, const char *end)
+{
+    if (mp_typeof(*begin) != MP_ARRAY) {
+        Rcpp::stop("reply data isn't an array of tuples");
+    }
+
+    data = begin;
+    data_end = end;
+    first_tuple = begin;
+    count = static_cast<int>(mp_decode_array(&first_tuple));
+}
+
+void TarantoolReply::index_tuples()
+{
+    if (!tuples.empty() || count == 0) {
+        return;
+    }
+
+    tuples.reserve(count + 1);
+
+    const char *p = first_tuple;
+    for (int i = 0; i < count; i++) {
+        tuples.push_back(p);
+        mp_next(&p);
+    }
+    tuples.push_back(p);
+}
+
+SEXP TarantoolReply::tuple(int i)
+{
+    if (i < 1 || i > count) {
+        Rcpp::stop("tuple %d is out of range [1, %d]", i, count);
+    }
+
+    index_tuples();
+
+    msgpack::unpacked unpacked;
+    unpack_referenced(unpacked, tuples[i - 1], tuples[i] - tuples[i - 1]);
+
+    return (unpack_object(unpacked.get()));
+}
+
+uint32_t TarantoolReply::field_no(SEXP name) const
+{
+    if (TYPEOF(name) == STRSXP && Rf_length(name) == 1) {
+        auto s = Rcpp::as<std::string>(name);
+        if (format) {
+            for (size_t j = 0; j < format->names.size(); j++) {
+                if (format->names[j] == s) {
+                    return (static_cast<uint32_t>(j));
+                }
+            }
+        }
+        Rcpp::stop("field '%s' isn't in the space format", s.c_str());
+    }
+
+    if ((TYPEOF(name) == INTSXP || TYPEOF(name) == REALSXP) && Rf_length(name) == 1) {
+        auto no = Rcpp::as<int>(name);
+        if (no < 1) {
+            Rcpp::stop("field number must be positive, got %d", no);
+        }
+        return (static_cast<uint32_t>(no - 1));
+    }
+
+    Rcpp::stop("field must be a name or a number, got %s", sexp_type_name(name).c_str());
+}
+
+SEXP TarantoolReply::field(SEXP name)
+{
+    auto no = field_no(name);
+
+    // the column is typed after the format if it has the field, so that the
+    // vector is the same as the data.frame column would be
+    TupleFormatPtr field_format;
+    if (format && no < format->kinds.size()) {
+        std::shared_ptr<TupleFormat> f(new TupleFormat());
+        f->names.push_back(format->names[no]);
+        f->kinds.push_back(format->kinds[no]);
+        field_format = f;
+    }
+
+    index_tuples();
+
+    DataFrameBuilder builder(count, field_format);
+
+    msgpack::object value;
+    msgpack::object row;
+    row.type = msgpack::type::ARRAY;
+    row.via.array.ptr = &value;
+
+    for (int i = 0; i < count; i++) {
+        const char *p = tuples[i];
+        if (mp_typeof(*p) != MP_ARRAY) {
+            Rcpp::stop("tuple %d isn't an array", i + 1);
+        }
+
+        msgpack::unpacked unpacked;
+        row.via.array.size = 0;
+
+        if (mp_decode_array(&p) > no) {
+            for (uint32_t j = 0; j < no; j++) {
+                mp_next(&p);
+            }
+            const char *end = p;
+            mp_next(&end);
+
+            unpack_referenced(unpacked, p, end - p);
+            value = unpacked.get();
+            row.via.array.size = 1;
+        }
+
+        builder.add_tuple(row);
+    }
+
+    Rcpp::List df(builder.build());
+    if (df.size() == 0) {
+        // none of the tuples has the field
+        return (Rcpp::LogicalVector(count, NA_LOGICAL));
+    }
+
+    return (df[0]);
+}
+
+SEXP TarantoolReply::as_data_frame() const
+{
+    msgpack::unpacked unpacked;
+    if (data != nullptr) {
+        unpack_referenced(unpacked, data, data_end - data);
+    }
+
+    return (unpack_data_frame(unpacked.get(), format.get()));
+}
+
+SEXP TarantoolReply::as_list() const
+{
+    if (data == nullptr) {
+        return (R_NilValue);
+    }
+
+    msgpack::unpacked unpacked;
+    unpack_referenced(unpacked, data, data_end - data);
+
+    return (unpack_object(unpacked.get()));
+}
@@ -0,0 +1,60 @@
+#ifndef TARANTOOLR_REPLY_H
+#define TARANTOOLR_REPLY_H
+
+#include <string>
+#include <vector>
+
+#include <Rcpp.h>
+
+#include "codec.h"
+#include "connection.h"
+
+// Reply to a select kept in its msgpack form. Nothing is converted into R
+// objects until it's asked for: length() only reads the array header, tuple()
+// and field() decode just the tuples and fields they return, as_data_frame()
+// and as_list() convert the whole reply the way select_df() and select() do.
+class TarantoolReply
+{
+public:
+    // Takes over the buffer of the reply.
+    TarantoolReply(TntReplyPtr reply, TupleFormatPtr format);
+
+    // Keeps a copy of the data, for replies coming from the cache.
+    TarantoolReply(const char *data, size_t size, TupleFormatPtr format);
+
+    int length() const
+    {
+        return (count);
+    }
+
+    // The i-th tuple (1-based) as a list.
+    SEXP tuple(int i);
+
+    // Values of the field in every tuple as a vector, NA for the tuples which
+    // are too short to have it. The field is given by its name in the space
+    // format or by its number (1-based).
+    SEXP field(SEXP name);
+
+    SEXP as_data_frame() const;
+    SEXP as_list() const;
+
+private:
+    TntReplyPtr reply;
+    std::string copy;
+    TupleFormatPtr format;
+
+    const char *data = nullptr;
+    const char *data_end = nullptr;
+    const char *first_tuple = nullptr;
+    int count = 0;
+
+    // start of every tuple and the end of the last one, filled in when a
+    // tuple is first asked for
+    std::vector<const char *> tuples;
+
+    void init(const char *begin, const char *end);
+    void index_tuples();
+    uint32_t field_no(SEXP name) const;
+};
+
+#endif
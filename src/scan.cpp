@@ -0,0 +1,293 @@
+#include <cstring>
+
+#include "codec.h"
+#include "scan.h"
+
+static bool is_key(const msgpack::object &obj, const char *key)
+{
+    auto size = std::strlen(key);
+    return (obj.type == msgpack::type::STR && obj.via.str.size == size && std::memcmp(obj.via.str.ptr, key, size) == 0);
+}
+
+// Reads field numbers of the index key parts and whether the index is unique.
+static void fetch_index_def(Connection &conn, uint32_t space_id, uint32_t index_id, std::vector<uint32_t> &parts, bool &unique)
+{
+    msgpack::sbuffer buff;
+    msgpack::packer<msgpack::sbuffer> pk(&buff);
+    pk.pack_array(2);
+    pk.pack(space_id);
+    pk.pack(index_id);
+
+    auto key = TntStreamPtr(tnt_object_as(NULL, const_cast<char *>(buff.data()), buff.size()));
+
+    auto sync = conn.next_sync();
+    auto rc = tnt_select(conn.stream.get(), tnt_vsp_index, 0, 1, 0, TNT_ITER_EQ, key.get());
+    check_tnt_api_rc(rc, "tnt_select()");
+
+    conn.flush();
+
+    auto reply = conn.read_reply(sync);
+    if (reply->code != 0) {
+        Rcpp::stop(reply_error_msg(reply.get()));
+    }
+
+    msgpack::unpacked unpacked;
+    if (reply->data && reply->data_end) {
+        unpack_referenced(unpacked, reply->data, reply->data_end - reply->data);
+    }
+
+    const msgpack::object &tuples = unpacked.get();
+    if (tuples.type != msgpack::type::ARRAY || tuples.via.array.size == 0) {
+        Rcpp::stop("index %d of space %d doesn't exist.", static_cast<int>(index_id), static_cast<int>(space_id));
+    }
+
+    // _vindex tuple is [space_id, index_id, name, type, opts, parts], parts
+    // are either [field_no, type] pairs or maps with 'field' key
+    const msgpack::object &tuple = tuples.via.array.ptr[0];
+    if (tuple.type != msgpack::type::ARRAY || tuple.via.array.size < 6 || tuple.via.array.ptr[5].type != msgpack::type::ARRAY) {
+        Rcpp::stop("unsupported format of index definition");
+    }
+
+    unique = true;
+
+    const msgpack::object &opts = tuple.via.array.ptr[4];
+    if (opts.type == msgpack::type::MAP) {
+        for (uint32_t i = 0; i < opts.via.map.size; i++) {
+            const msgpack::object_kv &kv = opts.via.map.ptr[i];
+            if (is_key(kv.key, "unique") && kv.val.type == msgpack::type::BOOLEAN) {
+                unique = kv.val.via.boolean;
+            }
+        }
+    }
+
+    parts.clear();
+
+    const msgpack::object_array &desc = tuple.via.array.ptr[5].via.array;
+    for (uint32_t i = 0; i < desc.size; i++) {
+        const msgpack::object &part = desc.ptr[i];
+        if (part.type == msgpack::type::ARRAY && part.via.array.size > 0) {
+            parts.push_back(part.via.array.ptr[0].as<uint32_t>());
+        } else if (part.type == msgpack::type::MAP) {
+            for (uint32_t j = 0; j < part.via.map.size; j++) {
+                const msgpack::object_kv &kv = part.via.map.ptr[j];
+                if (is_key(kv.key, "field")) {
+                    parts.push_back(kv.val.as<uint32_t>());
+                }
+            }
+        } else {
+            Rcpp::stop("unsupported format of index definition");
+        }
+    }
+}
+
+// Compares fields the way the server does: numbers are equal when their
+// values are, no matter how they are encoded.
+static bool fields_equal(const msgpack::object &a, const msgpack::object &b)
+{
+    auto is_number = [](const msgpack::object &o) {
+        return o.type == msgpack::type::POSITIVE_INTEGER || o.type == msgpack::type::NEGATIVE_INTEGER || o.type == msgpack::type::FLOAT;
+    };
+    auto as_double = [](const msgpack::object &o) {
+        if (o.type == msgpack::type::POSITIVE_INTEGER) {
+            return static_cast<double>(o.via.u64);
+        } else if (o.type == msgpack::type::NEGATIVE_INTEGER) {
+            return static_cast<double>(o.via.i64);
+        }
+        return o.via.f64;
+    };
+
+    if (is_number(a) && is_number(b)) {
+        if (a.type != msgpack::type::FLOAT && b.type != msgpack::type::FLOAT) {
+            return (a.type == b.type && a.via.u64 == b.via.u64);
+        }
+        return (as_double(a) == as_double(b));
+    }
+
+    return (a == b);
+}
+
+TarantoolScan::TarantoolScan(ConnectionPtr conn, uint32_t space_id, uint32_t index, int iterator, uint32_t page_size,
+    bool prefetch, const char *key, size_t key_size)
+    : conn(conn)
+    , space_id(space_id)
+    , index(index)
+    , iterator(iterator)
+    , page_size(page_size)
+    , prefetch(prefetch)
+{
+    if (page_size == 0) {
+        Rcpp::stop("page_size must be a positive integer");
+    }
+
+    switch (iterator) {
+    case TNT_ITER_EQ:
+    case TNT_ITER_REQ:
+    case TNT_ITER_ALL:
+    case TNT_ITER_LT:
+    case TNT_ITER_LE:
+    case TNT_ITER_GE:
+    case TNT_ITER_GT:
+        break;
+    default:
+        Rcpp::stop("iterator %d can't be used for scan", iterator);
+    }
+
+    fetch_index_def(*conn, space_id, index, parts, unique);
+
+    key_buff.write(key, key_size);
+    msgpack::unpack(original_key, key, key_size);
+    check_original_key = (iterator == TNT_ITER_EQ || iterator == TNT_ITER_REQ) && original_key.get().type == msgpack::type::ARRAY
+        && original_key.get().via.array.size > 0;
+}
+
+TarantoolScan::~TarantoolScan()
+{
+    if (pending) {
+        conn->discard_reply(pending_sync);
+    }
+}
+
+void TarantoolScan::send_request()
+{
+    auto key = TntStreamPtr(tnt_object_as(NULL, const_cast<char *>(key_buff.data()), key_buff.size()));
+
+    auto sync = conn->next_sync();
+    auto rc = tnt_select(conn->stream.get(), space_id, index, page_size, offset, iterator, key.get());
+    check_tnt_api_rc(rc, "tnt_select()");
+
+    conn->flush();
+
+    pending = true;
+    pending_sync = sync;
+}
+
+bool TarantoolScan::matches_key(const msgpack::object &tuple, const msgpack::object &key_obj)
+{
+    const msgpack::object_array &key = key_obj.via.array;
+
+    for (uint32_t i = 0; i < key.size && i < parts.size(); i++) {
+        auto field = parts[i];
+        if (field >= tuple.via.array.size || !fields_equal(tuple.via.array.ptr[field], key.ptr[i])) {
+            return (false);
+        }
+    }
+
+    return (true);
+}
+
+void TarantoolScan::set_key(const msgpack::object &tuples)
+{
+    const msgpack::object_array &page = tuples.via.array;
+    const msgpack::object &last = page.ptr[page.size - 1];
+
+    bool continues_run = false;
+    if (!unique && last_key_run > 0) {
+        msgpack::unpacked prev_key;
+        msgpack::unpack(prev_key, key_buff.data(), key_buff.size());
+        continues_run = matches_key(page.ptr[0], prev_key.get());
+    }
+
+    pack_key(last);
+
+    // number of tuples at the end of the page with the same key as the last one
+    uint32_t run = 0;
+    if (!unique) {
+        msgpack::unpacked key;
+        unpack_referenced(key, key_buff.data(), key_buff.size());
+        while (run < page.size && matches_key(page.ptr[page.size - 1 - run], key.get())) {
+            run++;
+        }
+        if (run == page.size && continues_run) {
+            // the whole page has the same key as the end of the previous one
+            run += offset;
+        }
+    }
+
+    // the rest of the index is walked in the same direction
+    bool reverse = iterator == TNT_ITER_REQ || iterator == TNT_ITER_LE || iterator == TNT_ITER_LT;
+    if (unique) {
+        iterator = reverse ? TNT_ITER_LT : TNT_ITER_GT;
+        offset = 0;
+    } else {
+        // keys aren't unique, so tuples with the last key are skipped by
+        // offset, which is bounded by the number of duplicates
+        iterator = reverse ? TNT_ITER_LE : TNT_ITER_GE;
+        offset = run;
+    }
+    last_key_run = run;
+}
+
+void TarantoolScan::pack_key(const msgpack::object &tuple)
+{
+    key_buff.clear();
+    msgpack::packer<msgpack::sbuffer> pk(&key_buff);
+
+    pk.pack_array(parts.size());
+    for (auto field : parts) {
+        if (field >= tuple.via.array.size) {
+            Rcpp::stop("tuple doesn't have field %d which is part of the index", static_cast<int>(field + 1));
+        }
+        pk.pack(tuple.via.array.ptr[field]);
+    }
+}
+
+SEXP TarantoolScan::next_chunk()
+{
+    if (!pending) {
+        if (exhausted) {
+            return (R_NilValue);
+        }
+        send_request();
+    }
+
+    pending = false;
+    auto reply = conn->read_reply(pending_sync);
+    if (reply->code != 0) {
+        exhausted = true;
+        Rcpp::stop(reply_error_msg(reply.get()));
+    }
+
+    msgpack::unpacked unpacked;
+    if (reply->data && reply->data_end) {
+        unpack_referenced(unpacked, reply->data, reply->data_end - reply->data);
+    }
+
+    msgpack::object tuples = unpacked.get();
+    uint32_t n = tuples.type == msgpack::type::ARRAY ? tuples.via.array.size : 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        const msgpack::object &tuple = tuples.via.array.ptr[i];
+        if (tuple.type != msgpack::type::ARRAY) {
+            Rcpp::stop("unexpected server reply: tuple %d is %s instead of an array", static_cast<int>(i + 1),
+                msgpack_type_name(tuple.type).c_str());
+        }
+        if (check_original_key && !matches_key(tuple, original_key.get())) {
+            // went past the tuples with the requested key
+            tuples.via.array.size = i;
+            exhausted = true;
+            break;
+        }
+    }
+
+    if (n < page_size) {
+        exhausted = true;
+    }
+
+    if (n == 0 || tuples.via.array.size == 0) {
+        // the previous page ended exactly where the tuples did
+        exhausted = true;
+        return (R_NilValue);
+    }
+
+    if (!exhausted) {
+        set_key(tuples);
+        if (prefetch) {
+            // server prepares the next page while this one is converted
+            send_request();
+        }
+    }
+
+    auto format = conn->tuple_format(space_id);
+
+    return (unpack_data_frame(tuples, format.get()));
+}
@@ -0,0 +1,68 @@
+#ifndef TARANTOOLR_SCAN_H
+#define TARANTOOLR_SCAN_H
+
+#include <vector>
+
+#include <Rcpp.h>
+
+#include <msgpack.hpp>
+
+#include "connection.h"
+
+// Cursor walking over an index in pages of bounded size. Every page after
+// the first one is selected with GT (or LT for reverse iterators) starting
+// from the key of the last tuple seen, so the server never has to skip over
+// the tuples which were already returned the way it does with offsets. For
+// non unique indexes GE (LE) is used instead and only the tuples sharing the
+// last key are skipped.
+class TarantoolScan
+{
+public:
+    TarantoolScan(ConnectionPtr conn, uint32_t space_id, uint32_t index, int iterator, uint32_t page_size, bool prefetch,
+        const char *key, size_t key_size);
+    ~TarantoolScan();
+
+    // Returns next page as a data.frame or NULL when there are no more tuples.
+    SEXP next_chunk();
+
+    bool done()
+    {
+        return (exhausted && !pending);
+    }
+
+private:
+    ConnectionPtr conn;
+    uint32_t space_id;
+    uint32_t index;
+    int iterator;
+    uint32_t page_size;
+    bool prefetch;
+
+    // field numbers of the index key parts
+    std::vector<uint32_t> parts;
+    bool unique = true;
+
+    // key the next page starts from
+    msgpack::sbuffer key_buff;
+
+    // key the scan was started with, for EQ and REQ iterators tuples must
+    // match it
+    msgpack::unpacked original_key;
+    bool check_original_key;
+
+    bool exhausted = false;
+    bool pending = false;
+    uint64_t pending_sync = 0;
+
+    // offset of the next page and the number of tuples with its key which
+    // were already returned
+    uint32_t offset = 0;
+    uint32_t last_key_run = 0;
+
+    void send_request();
+    bool matches_key(const msgpack::object &tuple, const msgpack::object &key);
+    void set_key(const msgpack::object &tuples);
+    void pack_key(const msgpack::object &tuple);
+};
+
+#endif
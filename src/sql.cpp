@@ -0,0 +1,178 @@
+// [[Rcpp::plugins(cpp11)]]
+
+#include <string>
+
+#include <msgpuck.h>
+
+#include "sql.h"
+
+// Keys of the bodies of SQL requests and replies.
+static const uint32_t kSqlOptions = 0x2b;
+static const uint32_t kSqlMetadata = 0x32;
+static const uint32_t kSqlBindCount = 0x34;
+static const uint32_t kSqlText = 0x40;
+static const uint32_t kSqlBind = 0x41;
+static const uint32_t kSqlInfo = 0x42;
+static const uint32_t kSqlStmtId = 0x43;
+
+// Keys of the SQL info map.
+static const uint64_t kSqlInfoRowCount = 0;
+static const uint64_t kSqlInfoAutoincrementIds = 1;
+
+static void pack_sql_bind(msgpack::packer<msgpack::sbuffer> &pk, SEXP params)
+{
+    pk.pack(kSqlBind);
+
+    if (Rf_isNull(params)) {
+        pk.pack_array(0);
+        return;
+    }
+
+    Rcpp::List values(params);
+    SEXP names = Rf_getAttrib(values, R_NamesSymbol);
+
+    pk.pack_array(values.size());
+    for (Rcpp::List::iterator it = values.begin(); it != values.end(); ++it) {
+        std::string name = Rf_isNull(names) ? "" : CHAR(STRING_ELT(names, it - values.begin()));
+        if (!name.empty()) {
+            if (name[0] != ':' && name[0] != '@' && name[0] != '$') {
+                name = ":" + name;
+            }
+            pk.pack_map(1);
+            pk.pack(name);
+        }
+        pack_elem(it, pk);
+    }
+}
+
+void pack_sql_execute(msgpack::sbuffer &buff, const std::string &sql, SEXP params)
+{
+    msgpack::packer<msgpack::sbuffer> pk(&buff);
+    pk.pack_map(3);
+    pk.pack(kSqlText);
+    pk.pack(sql);
+    pack_sql_bind(pk, params);
+    pk.pack(kSqlOptions);
+    pk.pack_array(0);
+}
+
+void pack_sql_execute(msgpack::sbuffer &buff, uint64_t stmt_id, SEXP params)
+{
+    msgpack::packer<msgpack::sbuffer> pk(&buff);
+    pk.pack_map(3);
+    pk.pack(kSqlStmtId);
+    pk.pack(stmt_id);
+    pack_sql_bind(pk, params);
+    pk.pack(kSqlOptions);
+    pk.pack_array(0);
+}
+
+void pack_sql_prepare(msgpack::sbuffer &buff, const std::string &sql)
+{
+    msgpack::packer<msgpack::sbuffer> pk(&buff);
+    pk.pack_map(1);
+    pk.pack(kSqlText);
+    pk.pack(sql);
+}
+
+void pack_sql_unprepare(msgpack::sbuffer &buff, uint64_t stmt_id)
+{
+    msgpack::packer<msgpack::sbuffer> pk(&buff);
+    pk.pack_map(1);
+    pk.pack(kSqlStmtId);
+    pk.pack(stmt_id);
+}
+
+static void parse_sql_info(const msgpack::object &info, SqlReply &result)
+{
+    if (info.type != msgpack::type::MAP) {
+        return;
+    }
+
+    for (uint32_t k = 0; k < info.via.map.size; k++) {
+        const msgpack::object_kv &kv = info.via.map.ptr[k];
+        if (kv.key.type != msgpack::type::POSITIVE_INTEGER) {
+            continue;
+        }
+
+        if (kv.key.via.u64 == kSqlInfoRowCount && kv.val.type == msgpack::type::POSITIVE_INTEGER) {
+            result.row_count = kv.val.via.u64;
+        } else if (kv.key.via.u64 == kSqlInfoAutoincrementIds && kv.val.type == msgpack::type::ARRAY) {
+            for (uint32_t i = 0; i < kv.val.via.array.size; i++) {
+                const msgpack::object &id = kv.val.via.array.ptr[i];
+                if (id.type == msgpack::type::POSITIVE_INTEGER) {
+                    result.autoincrement_ids.push_back(static_cast<int64_t>(id.via.u64));
+                } else if (id.type == msgpack::type::NEGATIVE_INTEGER) {
+                    result.autoincrement_ids.push_back(id.via.i64);
+                }
+            }
+        }
+    }
+}
+
+SqlReply SqlReply::parse(const TntReply *reply, ReplyArena &arena)
+{
+    SqlReply result;
+
+    // tnt_reply only points at the data, the rest of the body follows the
+    // header in the reply buffer
+    const char *body = reply->buf;
+    const char *end = reply->buf + reply->buf_size;
+    mp_next(&body);
+    if (body >= end) {
+        return (result);
+    }
+
+    msgpack::object obj = arena.unpack(body, end - body);
+    if (obj.type != msgpack::type::MAP) {
+        Rcpp::stop("unexpected server reply: %s instead of a map", msgpack_type_name(obj.type).c_str());
+    }
+
+    for (uint32_t k = 0; k < obj.via.map.size; k++) {
+        const msgpack::object_kv &kv = obj.via.map.ptr[k];
+        if (kv.key.type != msgpack::type::POSITIVE_INTEGER) {
+            continue;
+        }
+
+        switch (kv.key.via.u64) {
+        case kSqlMetadata:
+            result.format = TupleFormat::parse_sql_metadata(kv.val);
+            break;
+        case TNT_DATA:
+            result.rows = kv.val;
+            break;
+        case kSqlInfo:
+            parse_sql_info(kv.val, result);
+            break;
+        case kSqlStmtId:
+            if (kv.val.type == msgpack::type::POSITIVE_INTEGER) {
+                result.stmt_id = kv.val.via.u64;
+                result.has_stmt_id = true;
+            }
+            break;
+        case kSqlBindCount:
+            if (kv.val.type == msgpack::type::POSITIVE_INTEGER) {
+                result.bind_count = static_cast<uint32_t>(kv.val.via.u64);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return (result);
+}
+
+SEXP sql_result(const SqlReply &reply)
+{
+    if (reply.format) {
+        return (unpack_data_frame(reply.rows, reply.format.get()));
+    }
+
+    Rcpp::NumericVector ids(reply.autoincrement_ids.size());
+    for (size_t i = 0; i < reply.autoincrement_ids.size(); i++) {
+        ids[i] = static_cast<double>(reply.autoincrement_ids[i]);
+    }
+
+    return (Rcpp::List::create(Rcpp::Named("row_count") = static_cast<double>(reply.row_count), Rcpp::Named("autoincrement_ids") = ids));
+}
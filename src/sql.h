@@ -0,0 +1,58 @@
+#ifndef TARANTOOLR_SQL_H
+#define TARANTOOLR_SQL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Rcpp.h>
+
+#include <msgpack.hpp>
+
+#include "arena.h"
+#include "codec.h"
+#include "connection.h"
+
+// Types of SQL requests (tarantool 2.x), which tarantool-c doesn't know of.
+static const uint32_t kSqlExecute = 11;
+static const uint32_t kSqlPrepare = 13;
+
+// Packs the body of EXECUTE request of the statement given by its text or by
+// the id it was prepared with. Elements of params (a list or a vector, NULL
+// if there are none) are bound to the parameters of the statement: unnamed
+// ones by position, named ones by name (':' is prepended to the names which
+// don't start with ':', '@' or '$').
+void pack_sql_execute(msgpack::sbuffer &buff, const std::string &sql, SEXP params);
+void pack_sql_execute(msgpack::sbuffer &buff, uint64_t stmt_id, SEXP params);
+
+void pack_sql_prepare(msgpack::sbuffer &buff, const std::string &sql);
+
+// Packs the body of PREPARE request which, having the id of the statement
+// instead of its text, unprepares it.
+void pack_sql_unprepare(msgpack::sbuffer &buff, uint64_t stmt_id);
+
+// Body of a reply to EXECUTE or PREPARE, unpacked into the arena.
+struct SqlReply {
+    // columns of the result, null for statements which don't return rows
+    TupleFormatPtr format;
+    msgpack::object rows;
+
+    // number of rows changed by the statement and ids generated for them
+    uint64_t row_count = 0;
+    std::vector<int64_t> autoincrement_ids;
+
+    // id of the statement and number of its parameters, only in replies to
+    // PREPARE
+    uint64_t stmt_id = 0;
+    bool has_stmt_id = false;
+    uint32_t bind_count = 0;
+
+    static SqlReply parse(const TntReply *reply, ReplyArena &arena);
+};
+
+// The rows of the reply as a data.frame with the columns typed after the
+// metadata or, for the statements which don't return rows, a list with
+// row_count and autoincrement_ids.
+SEXP sql_result(const SqlReply &reply);
+
+#endif
@@ -1,90 +1,118 @@
 // [[Rcpp::plugins(cpp11)]]
 
+#include <poll.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <memory>
-#include <sstream>
+#include <cstdlib>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <Rcpp.h>
 
 #include <tarantool/tarantool.h>
+#include <tarantool/tnt_buf.h>
 #include <tarantool/tnt_net.h>
 #include <tarantool/tnt_opt.h>
 
 #include <msgpack.hpp>
+#include <msgpuck.h>
 
-using TntStream = struct tnt_stream;
-using TntReply = struct tnt_reply;
-
-class TntStreamDeleter
-{
-public:
-    void operator()(TntStream *s)
-    {
-        tnt_stream_free(s);
-    }
-};
-
-class TntReplyDeleter
-{
-public:
-    void operator()(TntReply *r)
-    {
-        tnt_reply_free(r);
-        // free(r);
-    }
-};
-
-using TntStreamPtr = std::unique_ptr<TntStream, TntStreamDeleter>;
-using TntReplyPtr = std::unique_ptr<TntReply, TntReplyDeleter>;
-using TntStreamRawPtr = TntStream *;
+#include "codec.h"
+#include "connection.h"
+#include "replica.h"
+#include "reply.h"
+#include "scan.h"
+#include "sql.h"
 
 static const std::string kDefaultHost = "localhost";
 static const int kDefaultPort = 3301;
 static const std::string kDefaultUser = "";
 static const std::string kDefaultPassword = "";
 
+// Number of tuples scan() fetches at once unless told otherwise.
+static const uint32_t kDefaultPageSize = 1000;
+
+// Number of select_many(), update_many() and upsert_many() requests in flight
+// unless told otherwise.
+static const int kDefaultManyDepth = 1000;
+
 // FIXME: implement all operators
 static const std::unordered_set<char> valid_update_operators{ '+', '-', '&', '|', '^', '=', '#', '!' };
 
+static void get_select_params(const Rcpp::List &params, uint32_t &index, uint32_t &limit, uint32_t &offset, int &iterator);
+static int get_depth(const Rcpp::List &params);
+static bool is_lazy(const Rcpp::List &params);
+static TntStreamPtr pack_buffer(msgpack::sbuffer &buff, SEXP e);
+static void pack_value(msgpack::sbuffer &buff, SEXP e);
+static SEXP unpack_reply(const TntReply *reply);
+static void reset_requests(TntStreamPtr &requests);
+
+class TarantoolPipeline;
+class TarantoolFuture;
+
 class Tarantool
 {
 public:
     Tarantool()
     {
-        initialize(kDefaultHost, kDefaultPort, kDefaultUser, kDefaultPassword);
+        initialize(kDefaultHost, kDefaultPort, kDefaultUser, kDefaultPassword, Rcpp::List());
     }
 
     Tarantool(std::string host, int port)
     {
-        initialize(host, port, kDefaultUser, kDefaultPassword);
+        initialize(host, port, kDefaultUser, kDefaultPassword, Rcpp::List());
     }
 
     Tarantool(std::string host, int port, std::string user, std::string password)
     {
-        initialize(host, port, user, password);
+        initialize(host, port, user, password, Rcpp::List());
+    }
+
+    Tarantool(std::string host, int port, std::string user, std::string password, const Rcpp::List options)
+    {
+        initialize(host, port, user, password, options);
+    }
+
+    explicit Tarantool(ConnectionPtr conn)
+        : conn(conn)
+    {
     }
 
     SEXP ping()
     {
+        RequestTimer timer(conn->metrics, RequestMetrics::Ping);
+
         return (ping_impl());
     }
 
     SEXP insert(SEXP space, SEXP tpl)
     {
+        RequestTimer timer(conn->metrics, RequestMetrics::Insert);
+
         TntStreamPtr packed_tuple = pack_buffer(tpl);
 
-        return (insert_impl(space, packed_tuple));
+        return (read_server_reply(insert_request(space, packed_tuple)));
     }
 
     SEXP replace(SEXP space, SEXP tpl)
     {
+        RequestTimer timer(conn->metrics, RequestMetrics::Replace);
+
         TntStreamPtr packed_tuple = pack_buffer(tpl);
 
-        return (replace_impl(space, packed_tuple));
+        return (read_server_reply(replace_request(space, packed_tuple)));
     }
 
     SEXP select(SEXP space, SEXP key, const Rcpp::List params)
     {
+        RequestTimer timer(conn->metrics, RequestMetrics::Select);
+
         TntStreamPtr packed_key = pack_buffer(key);
 
         uint32_t index = 0;
@@ -92,27 +120,39 @@ public:
         uint32_t offset = 0;
         int iterator = TNT_ITER_EQ;
 
-        if (params.containsElementNamed("index")) {
-            index = Rcpp::as<uint32_t>(params["index"]);
-        }
+        get_select_params(params, index, limit, offset, iterator);
 
-        if (params.containsElementNamed("limit")) {
-            limit = Rcpp::as<uint32_t>(params["limit"]);
+        // lazy = TRUE returns the reply undecoded, see TarantoolReply
+        if (is_lazy(params)) {
+            return (select_lazy(space, packed_key, index, limit, offset, iterator));
         }
 
-        if (params.containsElementNamed("offset")) {
-            offset = Rcpp::as<uint32_t>(params["offset"]);
-        }
+        size_t size = 0;
+        auto data = select_data(space, packed_key, index, limit, offset, iterator, size);
 
-        if (params.containsElementNamed("iterator")) {
-            iterator = Rcpp::as<int>(params["iterator"]);
-        }
+        return (unpack_view(data, size));
+    }
+
+    SEXP select_df(SEXP space, SEXP key, const Rcpp::List params)
+    {
+        RequestTimer timer(conn->metrics, RequestMetrics::Select);
+
+        TntStreamPtr packed_key = pack_buffer(key);
+
+        uint32_t index = 0;
+        uint32_t limit = std::numeric_limits<uint32_t>::max();
+        uint32_t offset = 0;
+        int iterator = TNT_ITER_EQ;
+
+        get_select_params(params, index, limit, offset, iterator);
 
-        return (select_impl(space, packed_key, index, limit, offset, iterator));
+        return (select_df_impl(space, packed_key, index, limit, offset, iterator));
     }
 
     SEXP delete_(SEXP space, SEXP key, const Rcpp::List params)
     {
+        RequestTimer timer(conn->metrics, RequestMetrics::Delete);
+
         TntStreamPtr packed_key = pack_buffer(key);
 
         uint32_t index = 0;
@@ -121,11 +161,13 @@ public:
             index = Rcpp::as<uint32_t>(params["index"]);
         }
 
-        return (delete_impl(space, packed_key, index));
+        return (read_server_reply(delete_request(space, packed_key, index)));
     }
 
     SEXP update(SEXP space, SEXP tpl, const Rcpp::List params)
     {
+        RequestTimer timer(conn->metrics, RequestMetrics::Update);
+
         TntStreamPtr packed_tuple = pack_buffer(tpl);
 
         uint32_t index = 0;
@@ -141,11 +183,13 @@ public:
         Rcpp::List ops_desc = Rcpp::as<Rcpp::List>(params["ops"]);
         TntStreamPtr packed_ops = pack_update_ops(ops_desc);
 
-        return (update_impl(space, packed_tuple, index, packed_ops));
+        return (read_server_reply(update_request(space, packed_tuple, index, packed_ops)));
     }
 
     SEXP upsert(SEXP space, SEXP tpl, const Rcpp::List params)
     {
+        RequestTimer timer(conn->metrics, RequestMetrics::Upsert);
+
         TntStreamPtr packed_tuple = pack_buffer(tpl);
 
         if (!params.containsElementNamed("ops")) {
@@ -155,242 +199,431 @@ public:
         Rcpp::List ops_desc = Rcpp::as<Rcpp::List>(params["ops"]);
         TntStreamPtr packed_ops = pack_update_ops(ops_desc);
 
-        return (upsert_impl(space, packed_tuple, packed_ops));
+        return (read_server_reply(upsert_request(space, packed_tuple, packed_ops)));
     }
 
     SEXP call(const std::string &func, SEXP args)
     {
+        RequestTimer timer(conn->metrics, RequestMetrics::Call);
+
         TntStreamPtr packed_args = pack_buffer(args);
 
-        return (call_impl(func, packed_args));
+        return (read_server_reply(call_request(func, packed_args)));
     }
 
     SEXP evaluate(const std::string &lua_statement, SEXP args)
     {
+        RequestTimer timer(conn->metrics, RequestMetrics::Eval);
+
         TntStreamPtr packed_args = pack_buffer(args);
 
-        return (evaluate_impl(lua_statement, packed_args));
+        return (read_server_reply(evaluate_request(lua_statement, packed_args)));
     }
 
-private:
-    TntStreamPtr stream;
-    msgpack::sbuffer buff;
-    msgpack::sbuffer update_op_buff;
+    // Same as call() and evaluate(), for Lua code returning a table of
+    // columns, {name = {values...}, ...}, which is converted into a data.frame
+    // with a typed vector per column (see unpack_columns()).
+    SEXP call_columns(const std::string &func, SEXP args)
+    {
+        RequestTimer timer(conn->metrics, RequestMetrics::Call);
 
-    void initialize(std::string host, int port, std::string user, std::string password);
-    std::string mk_connect_uri(std::string host, int port, std::string user, std::string password);
-    std::string mk_error_msg(TntStreamPtr &stream);
-    void unpack_msgpack_object(const msgpack::object &obj, Rcpp::List &l);
-    Rcpp::List pack_list(Rcpp::List x, msgpack::packer<msgpack::sbuffer> &pk);
-    void pack_elem(Rcpp::List::iterator &it, msgpack::packer<msgpack::sbuffer> &pk);
-    void unpack_array(const std::vector<msgpack::object> &v, Rcpp::List &l);
-    void unpack_map(const std::map<std::string, msgpack::object> &v, Rcpp::List &l);
-    SEXP read_server_reply();
-    int get_space_id(SEXP space);
-    TntStreamPtr pack_update_ops(const Rcpp::List &ops_desc);
-    TntStreamPtr pack_buffer(SEXP tpl);
-    TntStreamPtr pack_update_arg(SEXP tpl);
-    void check_tnt_api_rc(int rc, const char *function_name);
-    std::string sexp_type_name(SEXP x);
-    std::string msgpack_type_name(int type);
+        TntStreamPtr packed_args = pack_buffer(args);
 
-    SEXP ping_impl();
-    SEXP insert_impl(SEXP space, TntStreamPtr &tuple);
-    SEXP replace_impl(SEXP space, TntStreamPtr &tuple);
-    SEXP select_impl(SEXP space, TntStreamPtr &key, uint32_t index, uint32_t limit, uint32_t offset, int iterator);
-    SEXP delete_impl(SEXP space, TntStreamPtr &key, uint32_t index);
-    SEXP update_impl(SEXP space, TntStreamPtr &tuple, uint32_t index, TntStreamPtr &ops);
-    SEXP upsert_impl(SEXP space, TntStreamPtr &tuple, TntStreamPtr &ops);
-    SEXP call_impl(const std::string &func, TntStreamPtr &args);
-    SEXP evaluate_impl(const std::string &lua_statement, TntStreamPtr &args);
-};
+        return (read_columns_reply(call_request(func, packed_args)));
+    }
 
-void Tarantool::pack_elem(Rcpp::List::iterator &it, msgpack::packer<msgpack::sbuffer> &pk)
-{
-    switch (TYPEOF(*it)) {
-    case VECSXP: {
-        *it = pack_list(*it, pk);
-        break;
+    SEXP eval_columns(const std::string &lua_statement, SEXP args)
+    {
+        RequestTimer timer(conn->metrics, RequestMetrics::Eval);
+
+        TntStreamPtr packed_args = pack_buffer(args);
+
+        return (read_columns_reply(evaluate_request(lua_statement, packed_args)));
     }
-    case REALSXP: {
-        auto v = Rcpp::as<double>(*it);
-        pk.pack(v);
-        break;
+
+    SEXP insert_df(SEXP space, SEXP df, int batch_size)
+    {
+        return (store_df_impl(space, df, batch_size, TNT_OP_INSERT));
     }
-    case INTSXP: {
-        if (Rf_isFactor(*it)) { // factors have internal type INTSXP too
-            // FIXME: deal with factors!
-            Rcpp::stop("R's factors not supported yet!");
-        } else {
-            auto v = Rcpp::as<int64_t>(*it);
-            pk.pack(v);
-        }
-        break;
-    }
-    case STRSXP: {
-        auto v = Rcpp::as<std::string>(*it);
-        pk.pack(v);
-        break;
-    }
-    case NILSXP:
-        pk.pack_nil();
-        break;
-    case LGLSXP: {
-        auto v = Rcpp::as<bool>(*it);
-        pk.pack(v);
-        break;
-    }
-    case RAWSXP: {
-        auto v = Rcpp::as<std::vector<uint8_t>>(*it);
-        pk.pack(v);
-        break;
-    }
-    default: {
-        // See https://github.com/wch/r-source/blob/e5b21d0397c607883ff25cca379687b86933d730/src/include/Rinternals.h
-        // for more details about R's internal data types
-        Rcpp::stop("unsupported R's data type: %s", sexp_type_name(*it).c_str());
-    }
-    } // switch
-}
-
-void Tarantool::unpack_msgpack_object(const msgpack::object &obj, Rcpp::List &l)
-{
-    if (obj.type == msgpack::type::POSITIVE_INTEGER) {
-        l.push_back(obj.as<unsigned long long>());
-    } else if (obj.type == msgpack::type::NEGATIVE_INTEGER) {
-        auto e = -static_cast<int64_t>(std::numeric_limits<unsigned long long>::max() - obj.as<long long>() + 1);
-        l.push_back(e);
-    } else if (obj.type == msgpack::type::FLOAT) {
-        l.push_back(obj.as<double>());
-    } else if (obj.type == msgpack::type::STR) {
-        l.push_back(obj.as<std::string>());
-    } else if (obj.type == msgpack::type::BIN) {
-        // FIXME: treat binaries as lists?
-        l.push_back(obj.as<std::vector<uint8_t>>());
-    } else if (obj.type == msgpack::type::NIL) {
-        l.push_back(R_NilValue);
-    } else if (obj.type == msgpack::type::BOOLEAN) {
-        l.push_back(obj.as<bool>());
-    } else {
-        Rcpp::stop("unsupported msgpack object: %s", msgpack_type_name(obj.type).c_str());
+
+    SEXP replace_df(SEXP space, SEXP df, int batch_size)
+    {
+        return (store_df_impl(space, df, batch_size, TNT_OP_REPLACE));
     }
-}
 
-void Tarantool::unpack_map(const std::map<std::string, msgpack::object> &m, Rcpp::List &l)
-{
-    std::vector<std::string> keys;
+    // Selects tuples matching every one of the keys (see KeyEncoder) with the
+    // requests pipelined, at most `depth` of them in flight (1000 by default).
+    // Returns a data.frame of all the tuples found, key_index column holds the
+    // number of the key a tuple was selected by.
+    SEXP select_many(SEXP space, SEXP keys, const Rcpp::List params);
+
+    // Applies the operations of the template (see prepare_update()) to the
+    // tuples with every one of the keys, taking arguments of the operations
+    // from args, a data.frame or a list of vectors with a column per
+    // operation and a row per key. Requests are pipelined, at most depth of
+    // them (an element of params, the same as for select_many()) in flight,
+    // a failed one doesn't stop the rest. Returns a logical vector, TRUE if
+    // the tuple was updated, FALSE if there's no tuple with the key, NA if the
+    // update failed with the error in the "errors" attribute.
+    SEXP update_many(SEXP space, SEXP keys, const Rcpp::List ops_template, SEXP args, const Rcpp::List params)
+    {
+        return (modify_many_impl(space, keys, ops_template, args, params, TNT_OP_UPDATE));
+    }
 
-    keys.reserve(m.size());
-    for (const auto &e : m) {
-        keys.push_back(e.first);
+    // Same, for upserts of the tuples (see KeyEncoder), TRUE for every one
+    // which succeeded.
+    SEXP upsert_many(SEXP space, SEXP tuples, const Rcpp::List ops_template, SEXP args, const Rcpp::List params)
+    {
+        return (modify_many_impl(space, tuples, ops_template, args, params, TNT_OP_UPSERT));
     }
 
-    for (const auto &e : m) {
-        if (e.second.type == msgpack::type::ARRAY) {
-            auto v = e.second.as<std::vector<msgpack::object>>();
-            Rcpp::List sub_l;
-            unpack_array(v, sub_l);
-            l.push_back(sub_l);
-        } else if (e.second.type == msgpack::type::MAP) {
-            auto m = e.second.as<std::map<std::string, msgpack::object>>();
-            Rcpp::List sub_l;
-            unpack_map(m, sub_l);
-            l.push_back(sub_l);
-        } else {
-            unpack_msgpack_object(e.second, l);
+    SEXP async_insert(SEXP space, SEXP tpl)
+    {
+        TntStreamPtr packed_tuple = pack_buffer(tpl);
+
+        return (future(insert_request(space, packed_tuple)));
+    }
+
+    SEXP async_replace(SEXP space, SEXP tpl)
+    {
+        TntStreamPtr packed_tuple = pack_buffer(tpl);
+
+        return (future(replace_request(space, packed_tuple)));
+    }
+
+    SEXP async_select(SEXP space, SEXP key, const Rcpp::List params)
+    {
+        return (future(send_select(space, key, params)));
+    }
+
+    SEXP async_delete(SEXP space, SEXP key, const Rcpp::List params)
+    {
+        TntStreamPtr packed_key = pack_buffer(key);
+
+        uint32_t index = 0;
+
+        if (params.containsElementNamed("index")) {
+            index = Rcpp::as<uint32_t>(params["index"]);
         }
+
+        return (future(delete_request(space, packed_key, index)));
     }
 
-    l.attr("names") = Rcpp::wrap(keys);
-}
+    SEXP async_call(const std::string &func, SEXP args)
+    {
+        return (future(send_call(func, args)));
+    }
 
-void Tarantool::unpack_array(const std::vector<msgpack::object> &v, Rcpp::List &l)
-{
-    for (const auto &e : v) {
-        if (e.type == msgpack::type::ARRAY) {
-            auto v = e.as<std::vector<msgpack::object>>();
-            Rcpp::List sub_l;
-            unpack_array(v, sub_l);
-            l.push_back(sub_l);
-        } else if (e.type == msgpack::type::MAP) {
-            auto m = e.as<std::map<std::string, msgpack::object>>();
-            Rcpp::List sub_l;
-            unpack_map(m, sub_l);
-            l.push_back(sub_l);
-        } else {
-            unpack_msgpack_object(e, l);
+    SEXP async_evaluate(const std::string &lua_statement, SEXP args)
+    {
+        TntStreamPtr packed_args = pack_buffer(args);
+
+        return (future(evaluate_request(lua_statement, packed_args)));
+    }
+
+    // Waits up to timeout seconds (forever if negative) for replies to the
+    // asynchronous requests, returns number of replies received.
+    int poll(double timeout)
+    {
+        return (conn->poll_replies(timeout < 0 ? -1 : static_cast<int>(timeout * 1000)));
+    }
+
+    SEXP scan(SEXP space, SEXP key, const Rcpp::List params)
+    {
+        auto space_id = conn->get_space_id(space);
+        pack_value(buff, key);
+
+        uint32_t index = 0;
+        uint32_t limit = std::numeric_limits<uint32_t>::max();
+        uint32_t offset = 0;
+        int iterator = TNT_ITER_EQ;
+
+        get_select_params(params, index, limit, offset, iterator);
+
+        // pages are selected by key, there is nothing the offset and the
+        // limit could be applied to
+        if (params.containsElementNamed("limit") || params.containsElementNamed("offset")) {
+            Rcpp::stop("scan doesn't support limit and offset, stop fetching pages or use select instead");
+        }
+
+        uint32_t page_size = kDefaultPageSize;
+        bool prefetch = false;
+
+        if (params.containsElementNamed("page_size")) {
+            page_size = Rcpp::as<uint32_t>(params["page_size"]);
+        }
+
+        if (params.containsElementNamed("prefetch")) {
+            prefetch = Rcpp::as<bool>(params["prefetch"]);
         }
+
+        return (Rcpp::internal::make_new_object(
+            new TarantoolScan(conn, space_id, index, iterator, page_size, prefetch, buff.data(), buff.size())));
     }
-}
 
-Rcpp::List Tarantool::pack_list(Rcpp::List x, msgpack::packer<msgpack::sbuffer> &pk)
-{
-    pk.pack_array(x.size());
+    // Halves of select(), select_df() and call() for the requests whose
+    // replies are waited for by the caller (see TarantoolPool's hedged
+    // reads). Sending returns sync id of the request.
+    uint64_t send_select(SEXP space, SEXP key, const Rcpp::List params);
+    SEXP receive_select(SEXP space, uint64_t sync, const Rcpp::List params, bool data_frame);
 
-    for (Rcpp::List::iterator it = x.begin(); it != x.end(); ++it) {
-        pack_elem(it, pk);
+    uint64_t send_call(const std::string &func, SEXP args)
+    {
+        TntStreamPtr packed_args = pack_buffer(args);
+
+        return (call_request(func, packed_args));
     }
 
-    return (x);
-}
+    SEXP receive(uint64_t sync)
+    {
+        return (read_server_reply(sync));
+    }
 
-std::string Tarantool::mk_error_msg(TntStreamPtr &stream)
-{
-    std::string msg = std::string("tarantool: ") + std::string(tnt_strerror(stream.get()));
-    return (msg);
-}
+    // Time every reply is waited for, in seconds, negative value means
+    // forever. A request which times out fails, the reply to it is dropped
+    // when it arrives.
+    double timeout() const
+    {
+        return (conn->timeout());
+    }
+
+    SEXP set_timeout(double seconds)
+    {
+        conn->set_timeout(seconds);
+
+        return (R_NilValue);
+    }
+
+    SEXP pipeline();
+    SEXP prepare_select(SEXP space, int index, int iterator, SEXP limit);
+    SEXP prepare_update(SEXP space, const Rcpp::List ops_template);
+
+    // Executes the SQL statement with the parameters bound to the elements of
+    // params (see pack_sql_execute()). Returns a data.frame of the rows with
+    // the columns typed after the metadata of the reply or, for statements
+    // which don't return rows, a list with row_count and autoincrement_ids.
+    SEXP execute(const std::string &sql, SEXP params);
+
+    // Prepares the SQL statement on the server. Statements prepared through
+    // the connection are also executed by their ids by execute().
+    SEXP prepare(const std::string &sql);
+
+    // Read-through cache of select() and select_df() replies, see ReplyCache.
+    // ttl is in seconds, Inf keeps entries until they're evicted or
+    // invalidated by writes through this connection.
+    SEXP enable_cache(int max_entries, double ttl);
+    SEXP disable_cache();
+    SEXP set_cache_ttl(SEXP space, double ttl);
+    SEXP cache_stats();
+
+    // Instrumentation of the synchronous requests, see RequestMetrics. The
+    // pipelined ones of select_many(), update_many(), upsert_many(),
+    // insert_df() and replace_df() are timed as one request per call, with
+    // every reply counted. Pipelines and async_*() requests aren't timed, as
+    // their replies are read apart from sending them, only their traffic is
+    // accounted.
+    SEXP stats();
+    SEXP reset_stats();
+
+    // Gives back the memory the connection's reply arena has grown to, see
+    // ReplyArena.
+    SEXP trim_arena()
+    {
+        conn->trim_arena();
 
-void Tarantool::initialize(std::string host, int port, std::string user, std::string password)
+        return (R_NilValue);
+    }
+
+private:
+    ConnectionPtr conn;
+    msgpack::sbuffer buff;
+    msgpack::sbuffer update_op_buff;
+
+    void initialize(std::string host, int port, std::string user, std::string password, const Rcpp::List &options);
+    TntReplyPtr read_reply(uint64_t sync);
+    const TntReply *read_reply_view(uint64_t sync);
+    SEXP read_server_reply(uint64_t sync);
+    SEXP read_columns_reply(uint64_t sync);
+    SEXP unpack_view(const char *data, size_t size);
+    SEXP future(uint64_t sync);
+    TntStreamPtr pack_update_ops(const Rcpp::List &ops_desc);
+    TntStreamPtr pack_buffer(SEXP tpl);
+    TntStreamPtr pack_update_arg(SEXP tpl);
+
+    SEXP ping_impl();
+    uint64_t insert_request(SEXP space, TntStreamPtr &tuple);
+    uint64_t replace_request(SEXP space, TntStreamPtr &tuple);
+    uint64_t select_request(SEXP space, TntStreamPtr &key, uint32_t index, uint32_t limit, uint32_t offset, int iterator);
+    SEXP select_df_impl(SEXP space, TntStreamPtr &key, uint32_t index, uint32_t limit, uint32_t offset, int iterator);
+    SEXP select_lazy(SEXP space, TntStreamPtr &key, uint32_t index, uint32_t limit, uint32_t offset, int iterator);
+    const char *select_data(SEXP space, TntStreamPtr &key, uint32_t index, uint32_t limit, uint32_t offset, int iterator, size_t &size);
+    uint64_t delete_request(SEXP space, TntStreamPtr &key, uint32_t index);
+    uint64_t update_request(SEXP space, TntStreamPtr &tuple, uint32_t index, TntStreamPtr &ops);
+    uint64_t upsert_request(SEXP space, TntStreamPtr &tuple, TntStreamPtr &ops);
+    uint64_t call_request(const std::string &func, TntStreamPtr &args);
+    uint64_t evaluate_request(const std::string &lua_statement, TntStreamPtr &args);
+    SEXP store_df_impl(SEXP space, SEXP df, int batch_size, int op);
+    SEXP modify_many_impl(SEXP space, SEXP rows, const Rcpp::List &ops_template, SEXP args, const Rcpp::List &params, int op);
+};
+
+// Replies to the requests pipelined by select_many() and the like, which have
+// sync ids first_sync + [received, sent). The ones still unread when the
+// guard goes out of scope (an error or an interrupt) are discarded, so that
+// the connection doesn't keep them once they arrive.
+class PendingReplies
 {
-    stream = TntStreamPtr(tnt_net(nullptr));
-    auto uri = mk_connect_uri(host, port, user, password);
+public:
+    PendingReplies(ConnectionPtr &conn, uint64_t first_sync)
+        : conn(conn)
+        , first_sync(first_sync)
+    {
+    }
 
+    ~PendingReplies()
     {
-        auto err = tnt_error(stream.get());
-        if (err != TNT_EOK) {
-            Rcpp::stop(mk_error_msg(stream));
+        for (R_xlen_t i = received; i < sent; i++) {
+            conn->discard_reply(first_sync + i);
         }
     }
 
+    // sync id of the i-th request
+    uint64_t sync(R_xlen_t i) const
     {
-        auto err = tnt_set(stream.get(), TNT_OPT_URI, uri.c_str());
-        if (err != TNT_EOK) {
-            Rcpp::stop(mk_error_msg(stream));
-        }
+        return (first_sync + i);
+    }
+
+    R_xlen_t sent = 0;
+    R_xlen_t received = 0;
+
+private:
+    ConnectionPtr &conn;
+    uint64_t first_sync;
+};
+
+SEXP Tarantool::select_many(SEXP space, SEXP keys, const Rcpp::List params)
+{
+    uint32_t index = 0;
+    uint32_t limit = std::numeric_limits<uint32_t>::max();
+    uint32_t offset = 0;
+    int iterator = TNT_ITER_EQ;
 
-        tnt_set(stream.get(), TNT_OPT_SEND_BUF, 0);
-        tnt_set(stream.get(), TNT_OPT_RECV_BUF, 0);
+    get_select_params(params, index, limit, offset, iterator);
+    int depth = get_depth(params);
+
+    // the requests are timed as one, as in modify_many_impl()
+    RequestTimer timer(conn->metrics, RequestMetrics::Select);
+
+    auto space_id = conn->get_space_id(space);
+    KeyEncoder encoder(keys);
+    auto nkeys = encoder.size();
+
+    auto requests = TntStreamPtr(tnt_buf(NULL));
+    auto key = TntStreamPtr(tnt_object(NULL));
+    if (!requests || !key) {
+        Rcpp::stop("couldn't init tnt_stream object");
+    }
+
+    msgpack::packer<msgpack::sbuffer> pk(&buff);
+
+    DataFrameBuilder builder(0, conn->tuple_format(space_id));
+    std::vector<int> key_index;
+
+    // requests are sent in chunks of half the depth, so that the next chunk
+    // is processed by the server while replies to the previous one are
+    // decoded
+    R_xlen_t chunk = std::max(1, depth / 2);
+    PendingReplies pending(conn, conn->next_sync());
+    R_xlen_t &sent = pending.sent;
+    R_xlen_t &received = pending.received;
+
+    while (received < nkeys) {
+        while (sent < nkeys && sent - received + chunk <= depth) {
+            auto end = std::min(nkeys, sent + chunk);
+
+            reset_requests(requests);
+            requests->reqid = conn->stream->reqid;
+            for (R_xlen_t i = sent; i < end; i++) {
+                buff.clear();
+                encoder.pack_key(i, pk);
+                tnt_object_as(key.get(), buff.data(), buff.size());
+
+                auto rc = tnt_select(requests.get(), space_id, index, limit, offset, iterator, key.get());
+                check_tnt_api_rc(rc, "tnt_select()");
+            }
+            conn->stream->reqid = requests->reqid;
+            conn->write_requests(requests);
 
-        err = tnt_connect(stream.get());
-        if (err != TNT_EOK) {
-            Rcpp::stop(mk_error_msg(stream));
+            sent = end;
         }
 
-        err = tnt_reload_schema(stream.get());
-        if (err != TNT_EOK) {
-            Rcpp::stop(mk_error_msg(stream));
+        auto end = std::min(sent, received + chunk);
+        while (received < end) {
+            // the reply counts as received even if reading it fails, a
+            // request which timed out is discarded by read_reply()
+            auto i = received++;
+            auto reply = conn->read_reply(pending.sync(i));
+            if (reply->code != 0) {
+                Rcpp::stop("select of key %d failed: %s", static_cast<int>(i + 1), reply_error_msg(reply.get()).c_str());
+            }
+
+            if (reply->data == nullptr || reply->data_end == nullptr) {
+                continue;
+            }
+
+            msgpack::unpacked unpacked;
+            unpack_referenced(unpacked, reply->data, reply->data_end - reply->data);
+            const msgpack::object &tuples = unpacked.get();
+            if (tuples.type != msgpack::type::ARRAY) {
+                continue;
+            }
+            for (uint32_t t = 0; t < tuples.via.array.size; t++) {
+                builder.add_tuple(tuples.via.array.ptr[t]);
+                key_index.push_back(static_cast<int>(i + 1));
+            }
         }
+
+        Rcpp::checkUserInterrupt();
     }
+
+    Rcpp::List df = builder.build();
+    Rcpp::CharacterVector df_names(Rf_getAttrib(df, R_NamesSymbol));
+
+    Rcpp::List result(df.size() + 1);
+    Rcpp::CharacterVector names(df.size() + 1);
+    result[0] = Rcpp::IntegerVector(key_index.begin(), key_index.end());
+    names[0] = "key_index";
+    for (R_xlen_t j = 0; j < df.size(); j++) {
+        result[j + 1] = df[j];
+        names[j + 1] = df_names[j];
+    }
+
+    result.attr("names") = names;
+    result.attr("row.names") = df.attr("row.names");
+    result.attr("class") = "data.frame";
+
+    return (result);
+}
+
+void Tarantool::initialize(std::string host, int port, std::string user, std::string password, const Rcpp::List &options)
+{
+    conn = std::make_shared<Connection>(host, port, user, password, ConnectionOptions::parse(options));
 }
 
 SEXP Tarantool::ping_impl()
 {
     SEXP result = Rcpp::wrap(false);
 
+    auto &stream = conn->stream;
+
+    auto sync = conn->next_sync();
     auto rc = tnt_ping(stream.get());
     if (rc == -1) {
-        Rcpp::stop(mk_error_msg(stream));
+        Rcpp::stop(conn->mk_error_msg());
     }
 
-    auto reply = TntReplyPtr(tnt_reply_init(NULL));
-    if (!reply) {
-        Rcpp::stop(mk_error_msg(stream));
-    }
+    conn->flush();
 
-    rc = stream->read_reply(stream.get(), reply.get());
-    if (rc == -1) {
-        Rcpp::stop("tarantool: ping failed");
-    }
+    auto reply = conn->read_reply_view(sync);
     if (reply->code == 0) {
         result = Rcpp::wrap(true);
     } else {
@@ -406,244 +639,551 @@ SEXP Tarantool::ping_impl()
     return result;
 }
 
-SEXP Tarantool::insert_impl(SEXP space, TntStreamPtr &tuple)
+uint64_t Tarantool::insert_request(SEXP space, TntStreamPtr &tuple)
 {
-    auto space_id = get_space_id(space);
-    auto rc = tnt_insert(stream.get(), space_id, tuple.get());
+    auto space_id = conn->get_space_id(space);
+    conn->invalidate_cache(space_id);
+    auto sync = conn->next_sync();
+    auto rc = tnt_insert(conn->stream.get(), space_id, tuple.get());
     check_tnt_api_rc(rc, "tnt_insert()");
 
-    rc = tnt_flush(stream.get());
-    check_tnt_api_rc(rc, "tnt_flush()");
-
-    auto result = read_server_reply();
+    conn->flush();
 
-    return (result);
+    return (sync);
 }
 
-SEXP Tarantool::replace_impl(SEXP space, TntStreamPtr &tuple)
+uint64_t Tarantool::replace_request(SEXP space, TntStreamPtr &tuple)
 {
-    auto space_id = get_space_id(space);
-    auto rc = tnt_replace(stream.get(), space_id, tuple.get());
+    auto space_id = conn->get_space_id(space);
+    conn->invalidate_cache(space_id);
+    auto sync = conn->next_sync();
+    auto rc = tnt_replace(conn->stream.get(), space_id, tuple.get());
     check_tnt_api_rc(rc, "tnt_replace()");
 
-    rc = tnt_flush(stream.get());
-    check_tnt_api_rc(rc, "tnt_flush()");
-
-    auto result = read_server_reply();
+    conn->flush();
 
-    return (result);
+    return (sync);
 }
 
-SEXP Tarantool::select_impl(SEXP space, TntStreamPtr &key, uint32_t index, uint32_t limit, uint32_t offset, int iterator)
+uint64_t Tarantool::select_request(SEXP space, TntStreamPtr &key, uint32_t index, uint32_t limit, uint32_t offset, int iterator)
 {
-    auto space_id = get_space_id(space);
-    auto rc = tnt_select(stream.get(), space_id, index, limit, offset, iterator, key.get());
+    auto space_id = conn->get_space_id(space);
+    auto sync = conn->next_sync();
+    auto rc = tnt_select(conn->stream.get(), space_id, index, limit, offset, iterator, key.get());
     check_tnt_api_rc(rc, "tnt_select()");
 
-    rc = tnt_flush(stream.get());
-    check_tnt_api_rc(rc, "tnt_flush()");
-
-    auto result = read_server_reply();
+    conn->flush();
 
-    return (result);
+    return (sync);
 }
 
-SEXP Tarantool::delete_impl(SEXP space, TntStreamPtr &key, uint32_t index)
+SEXP Tarantool::select_df_impl(SEXP space, TntStreamPtr &key, uint32_t index, uint32_t limit, uint32_t offset, int iterator)
 {
-    auto space_id = get_space_id(space);
-    auto rc = tnt_delete(stream.get(), space_id, index, key.get());
-    check_tnt_api_rc(rc, "tnt_delete()");
+    // fetched first, so that nothing is read from the stream while the
+    // selected data is in use
+    auto format = conn->tuple_format(conn->get_space_id(space));
 
-    rc = tnt_flush(stream.get());
-    check_tnt_api_rc(rc, "tnt_flush()");
+    size_t size = 0;
+    auto data = select_data(space, key, index, limit, offset, iterator, size);
 
-    auto result = read_server_reply();
-
-    return (result);
+    return (unpack_data_frame(size > 0 ? conn->arena.unpack(data, size) : msgpack::object(), format.get()));
 }
 
-SEXP Tarantool::update_impl(SEXP space, TntStreamPtr &tuple, uint32_t index, TntStreamPtr &ops)
+uint64_t Tarantool::send_select(SEXP space, SEXP key, const Rcpp::List params)
 {
-    auto space_id = get_space_id(space);
-    auto rc = tnt_update(stream.get(), space_id, index, tuple.get(), ops.get());
-    check_tnt_api_rc(rc, "tnt_update()");
+    TntStreamPtr packed_key = pack_buffer(key);
 
-    rc = tnt_flush(stream.get());
-    check_tnt_api_rc(rc, "tnt_flush()");
+    uint32_t index = 0;
+    uint32_t limit = std::numeric_limits<uint32_t>::max();
+    uint32_t offset = 0;
+    int iterator = TNT_ITER_EQ;
 
-    auto result = read_server_reply();
+    get_select_params(params, index, limit, offset, iterator);
 
-    return (result);
+    return (select_request(space, packed_key, index, limit, offset, iterator));
 }
 
-SEXP Tarantool::upsert_impl(SEXP space, TntStreamPtr &tuple, TntStreamPtr &ops)
+SEXP Tarantool::receive_select(SEXP space, uint64_t sync, const Rcpp::List params, bool data_frame)
 {
-    auto space_id = get_space_id(space);
-    auto rc = tnt_upsert(stream.get(), space_id, tuple.get(), ops.get());
-    check_tnt_api_rc(rc, "tnt_upsert()");
+    auto reply = read_reply(sync);
 
-    rc = tnt_flush(stream.get());
-    check_tnt_api_rc(rc, "tnt_flush()");
+    bool lazy = !data_frame && is_lazy(params);
+    if (!data_frame && !lazy) {
+        return (unpack_reply(reply.get()));
+    }
 
-    auto result = read_server_reply();
+    auto format = conn->tuple_format(conn->get_space_id(space));
+    if (lazy) {
+        return (Rcpp::internal::make_new_object(new TarantoolReply(std::move(reply), format)));
+    }
 
-    return (result);
+    msgpack::unpacked unpacked;
+    if (reply->data && reply->data_end) {
+        unpack_referenced(unpacked, reply->data, reply->data_end - reply->data);
+    }
+
+    return (unpack_data_frame(unpacked.get(), format.get()));
 }
 
-SEXP Tarantool::call_impl(const std::string &func, TntStreamPtr &args)
+SEXP Tarantool::select_lazy(SEXP space, TntStreamPtr &key, uint32_t index, uint32_t limit, uint32_t offset, int iterator)
 {
-    auto rc = tnt_call(stream.get(), func.c_str(), func.size(), args.get());
-    check_tnt_api_rc(rc, "tnt_call()");
-
-    rc = tnt_flush(stream.get());
-    check_tnt_api_rc(rc, "tnt_flush()");
+    auto format = conn->tuple_format(conn->get_space_id(space));
 
-    auto result = read_server_reply();
+    size_t size = 0;
+    auto data = select_data(space, key, index, limit, offset, iterator, size);
 
-    return (result);
+    // the data is in the arena or the cache, the reply keeps a copy
+    return (Rcpp::internal::make_new_object(new TarantoolReply(data, size, format)));
 }
 
-SEXP Tarantool::evaluate_impl(const std::string &lua_statement, TntStreamPtr &args)
+const char *Tarantool::select_data(
+    SEXP space, TntStreamPtr &key, uint32_t index, uint32_t limit, uint32_t offset, int iterator, size_t &size)
 {
-    auto rc = tnt_eval(stream.get(), lua_statement.c_str(), lua_statement.size(), args.get());
-    check_tnt_api_rc(rc, "tnt_eval()");
+    auto &cache = conn->cache;
+    uint32_t space_id = 0;
+    std::string cache_key;
+
+    if (cache) {
+        // key is packed into buff
+        space_id = conn->get_space_id(space);
+        cache_key = ReplyCache::make_key(space_id, index, limit, offset, iterator, buff.data(), buff.size());
+
+        auto cached = cache->find(space_id, cache_key);
+        if (cached != nullptr) {
+            size = cached->size();
+            return (cached->data());
+        }
+    }
 
-    rc = tnt_flush(stream.get());
-    check_tnt_api_rc(rc, "tnt_flush()");
+    auto reply = read_reply_view(select_request(space, key, index, limit, offset, iterator));
+    size = reply->data && reply->data_end ? reply->data_end - reply->data : 0;
 
-    auto result = read_server_reply();
+    if (cache) {
+        cache->store(space_id, std::move(cache_key), reply->data, size);
+    }
 
-    return (result);
+    return (reply->data);
 }
 
-std::string Tarantool::mk_connect_uri(std::string host, int port, std::string user, std::string password)
+SEXP Tarantool::enable_cache(int max_entries, double ttl)
 {
-    std::stringstream ss;
-
-    if (!user.empty()) {
-        ss << user;
-    }
-
-    if (!password.empty()) {
-        ss << ":" << password;
-    }
-
-    if (!ss.str().empty()) {
-        ss << "@";
+    if (max_entries <= 0) {
+        Rcpp::stop("max_entries must be a positive integer");
     }
 
-    if (!host.empty() && port > 0) {
-        ss << host << ":" << port;
-    }
+    conn->cache.reset(new ReplyCache(max_entries, ttl));
 
-    return ss.str();
+    return (R_NilValue);
 }
 
-SEXP Tarantool::read_server_reply()
+SEXP Tarantool::disable_cache()
 {
-    SEXP result = R_NilValue;
+    conn->cache.reset();
 
-    auto reply = TntReplyPtr(tnt_reply_init(NULL));
-    if (!reply) {
-        Rcpp::stop("couldn't init tnt_reply object");
-    }
+    return (R_NilValue);
+}
 
-    auto rc = stream->read_reply(stream.get(), reply.get());
-    if (rc == -1) {
-        // FIXME: need to get meaningful error message.
-        Rcpp::stop("read_reply() failed");
+SEXP Tarantool::set_cache_ttl(SEXP space, double ttl)
+{
+    if (!conn->cache) {
+        Rcpp::stop("cache is not enabled");
     }
-    if (reply->code != 0) {
-        std::string err_msg;
-        if (reply->error && reply->error_end) {
-            err_msg = std::string(reply->error, reply->error_end - reply->error);
-        }
-        Rcpp::stop(err_msg);
-    } else {
-        if (reply->data && reply->data_end) {
-            msgpack::unpacked unpacked;
-            msgpack::unpack(unpacked, reply->data, reply->data_end - reply->data);
-            msgpack::object obj(unpacked.get());
 
-            auto v = obj.as<std::vector<msgpack::object>>();
-            Rcpp::List l;
-            unpack_array(v, l);
-
-            result = Rcpp::wrap(l);
-        }
-    }
+    conn->cache->set_ttl(conn->get_space_id(space), ttl);
 
-    return result;
+    return (R_NilValue);
 }
 
-int Tarantool::get_space_id(SEXP space)
+SEXP Tarantool::cache_stats()
 {
-    int space_id = -1;
-
-    auto t = TYPEOF(space);
-    if (t == STRSXP) {
-        auto s = Rcpp::as<std::string>(space);
-        space_id = tnt_get_spaceno(stream.get(), s.c_str(), s.size());
-        if (space_id == -1) {
-            Rcpp::stop("space '%s' doesn't exist.", s.c_str());
-        }
-    } else if (t == INTSXP || t == REALSXP) {
-        space_id = Rcpp::as<int>(space);
-    } else {
-        Rcpp::stop("space must be an integer or a string");
+    auto &cache = conn->cache;
+    if (!cache) {
+        return (R_NilValue);
     }
 
-    return space_id;
+    return (Rcpp::List::create(Rcpp::Named("hits") = static_cast<double>(cache->hits()),
+        Rcpp::Named("misses") = static_cast<double>(cache->misses()), Rcpp::Named("evictions") = static_cast<double>(cache->evictions()),
+        Rcpp::Named("entries") = static_cast<double>(cache->size())));
 }
 
-TntStreamPtr Tarantool::pack_update_ops(const Rcpp::List &x)
+// Returns list of "latency" data.frame with percentiles of every phase of the
+// requests by type (in microseconds), "requests" data.frame with reply sizes
+// and errors by type, the traffic of the connection in bytes and the memory its
+// reply arena holds.
+SEXP Tarantool::stats()
 {
-    int rc;
-    TntStreamPtr ops = TntStreamPtr(tnt_update_container(NULL));
+    const auto &metrics = conn->metrics;
 
-    for (const auto &v : x) {
-        if (TYPEOF(v) != VECSXP) {
-            Rcpp::stop("invalid structure of update operation description.");
+    int nops = 0;
+    for (int i = 0; i < RequestMetrics::kOpCount; i++) {
+        if (metrics.get(static_cast<RequestMetrics::Op>(i)) != nullptr) {
+            nops++;
         }
+    }
 
-        auto single_op = Rcpp::as<Rcpp::List>(v);
-
-        if (!single_op.containsElementNamed("field")) {
-            Rcpp::stop("missied 'field' value which is a mandatory option for update operation description.");
+    Rcpp::CharacterVector op(nops);
+    Rcpp::NumericVector requests(nops);
+    Rcpp::NumericVector errors(nops);
+    Rcpp::NumericVector reply_mean(nops);
+    Rcpp::NumericVector reply_p99(nops);
+    Rcpp::NumericVector reply_max(nops);
+
+    auto nrows = nops * RequestMetrics::kPhaseCount;
+    Rcpp::CharacterVector latency_op(nrows);
+    Rcpp::CharacterVector phase(nrows);
+    Rcpp::NumericVector count(nrows);
+    Rcpp::NumericVector mean(nrows);
+    Rcpp::NumericVector p50(nrows);
+    Rcpp::NumericVector p90(nrows);
+    Rcpp::NumericVector p99(nrows);
+    Rcpp::NumericVector p999(nrows);
+    Rcpp::NumericVector max(nrows);
+
+    static const double kNsPerUs = 1000;
+
+    int i = 0;
+    int row = 0;
+    for (int j = 0; j < RequestMetrics::kOpCount; j++) {
+        auto type = static_cast<RequestMetrics::Op>(j);
+        auto m = metrics.get(type);
+        if (m == nullptr) {
+            continue;
         }
 
-        auto field_no = Rcpp::as<uint32_t>(single_op["field"]);
-
-        if (!single_op.containsElementNamed("op")) {
-            Rcpp::stop("missied 'op' value which is a mandatory option for update operation description.");
+        op[i] = RequestMetrics::op_name(type);
+        requests[i] = m->reply_size.count();
+        errors[i] = m->errors.load(std::memory_order_relaxed);
+        reply_mean[i] = m->reply_size.mean();
+        reply_p99[i] = m->reply_size.quantile(0.99);
+        reply_max[i] = m->reply_size.max();
+        i++;
+
+        for (int k = 0; k < RequestMetrics::kPhaseCount; k++, row++) {
+            const auto &h = m->latency[k];
+            latency_op[row] = RequestMetrics::op_name(type);
+            phase[row] = RequestMetrics::phase_name(static_cast<RequestMetrics::Phase>(k));
+            count[row] = h.count();
+            mean[row] = h.mean() / kNsPerUs;
+            p50[row] = h.quantile(0.5) / kNsPerUs;
+            p90[row] = h.quantile(0.9) / kNsPerUs;
+            p99[row] = h.quantile(0.99) / kNsPerUs;
+            p999[row] = h.quantile(0.999) / kNsPerUs;
+            max[row] = h.max() / kNsPerUs;
         }
+    }
 
-        auto op = single_op["op"];
-        auto op_type = TYPEOF(op);
-        if (op_type != STRSXP) {
-            Rcpp::stop("update operator must be a string value.");
-        }
+    auto latency = Rcpp::DataFrame::create(Rcpp::Named("op") = latency_op, Rcpp::Named("phase") = phase, Rcpp::Named("count") = count,
+        Rcpp::Named("mean") = mean, Rcpp::Named("p50") = p50, Rcpp::Named("p90") = p90, Rcpp::Named("p99") = p99,
+        Rcpp::Named("p999") = p999, Rcpp::Named("max") = max, Rcpp::Named("stringsAsFactors") = false);
 
-        auto s = Rcpp::as<std::string>(op);
-        if (s.size() != 1) {
-            Rcpp::stop("invalid update operator: %s", s.c_str());
-        }
+    auto by_op = Rcpp::DataFrame::create(Rcpp::Named("op") = op, Rcpp::Named("requests") = requests, Rcpp::Named("errors") = errors,
+        Rcpp::Named("reply_bytes_mean") = reply_mean, Rcpp::Named("reply_bytes_p99") = reply_p99,
+        Rcpp::Named("reply_bytes_max") = reply_max, Rcpp::Named("stringsAsFactors") = false);
 
-        auto op_value = s[0];
+    return (Rcpp::List::create(Rcpp::Named("latency") = latency, Rcpp::Named("requests") = by_op,
+        Rcpp::Named("bytes_sent") = static_cast<double>(conn->bytes_sent()),
+        Rcpp::Named("bytes_received") = static_cast<double>(conn->bytes_received()),
+        Rcpp::Named("arena_bytes") = static_cast<double>(conn->arena.capacity())));
+}
+
+SEXP Tarantool::reset_stats()
+{
+    conn->reset_stats();
+
+    return (R_NilValue);
+}
+
+uint64_t Tarantool::delete_request(SEXP space, TntStreamPtr &key, uint32_t index)
+{
+    auto space_id = conn->get_space_id(space);
+    conn->invalidate_cache(space_id);
+    auto sync = conn->next_sync();
+    auto rc = tnt_delete(conn->stream.get(), space_id, index, key.get());
+    check_tnt_api_rc(rc, "tnt_delete()");
+
+    conn->flush();
+
+    return (sync);
+}
+
+uint64_t Tarantool::update_request(SEXP space, TntStreamPtr &tuple, uint32_t index, TntStreamPtr &ops)
+{
+    auto space_id = conn->get_space_id(space);
+    conn->invalidate_cache(space_id);
+    auto sync = conn->next_sync();
+    auto rc = tnt_update(conn->stream.get(), space_id, index, tuple.get(), ops.get());
+    check_tnt_api_rc(rc, "tnt_update()");
+
+    conn->flush();
+
+    return (sync);
+}
+
+uint64_t Tarantool::upsert_request(SEXP space, TntStreamPtr &tuple, TntStreamPtr &ops)
+{
+    auto space_id = conn->get_space_id(space);
+    conn->invalidate_cache(space_id);
+    auto sync = conn->next_sync();
+    auto rc = tnt_upsert(conn->stream.get(), space_id, tuple.get(), ops.get());
+    check_tnt_api_rc(rc, "tnt_upsert()");
+
+    conn->flush();
+
+    return (sync);
+}
+
+uint64_t Tarantool::call_request(const std::string &func, TntStreamPtr &args)
+{
+    auto sync = conn->next_sync();
+    auto rc = tnt_call(conn->stream.get(), func.c_str(), func.size(), args.get());
+    check_tnt_api_rc(rc, "tnt_call()");
+
+    conn->flush();
+
+    return (sync);
+}
+
+uint64_t Tarantool::evaluate_request(const std::string &lua_statement, TntStreamPtr &args)
+{
+    auto sync = conn->next_sync();
+    auto rc = tnt_eval(conn->stream.get(), lua_statement.c_str(), lua_statement.size(), args.get());
+    check_tnt_api_rc(rc, "tnt_eval()");
 
-        if (valid_update_operators.find(op_value) == valid_update_operators.end()) {
-            Rcpp::stop("invalid update operator: %c", op_value);
+    conn->flush();
+
+    return (sync);
+}
+
+// Stores rows of the data.frame sending them in pipelined batches of
+// batch_size requests. Returns logical vector with the status of every row,
+// server's error messages for the failed rows are in its "errors" attribute.
+SEXP Tarantool::store_df_impl(SEXP space, SEXP df, int batch_size, int op)
+{
+    if (batch_size <= 0) {
+        Rcpp::stop("batch_size must be a positive integer");
+    }
+
+    // the batches are timed as one request, as in modify_many_impl()
+    RequestTimer timer(conn->metrics, op == TNT_OP_INSERT ? RequestMetrics::Insert : RequestMetrics::Replace);
+
+    auto space_id = conn->get_space_id(space);
+    conn->invalidate_cache(space_id);
+    DataFrameEncoder encoder(df);
+    auto nrows = encoder.nrows();
+
+    Rcpp::LogicalVector status(nrows, true);
+    Rcpp::CharacterVector errors(nrows, NA_STRING);
+
+    auto requests = TntStreamPtr(tnt_buf(NULL));
+    auto tuple = TntStreamPtr(tnt_object(NULL));
+    if (!requests || !tuple) {
+        Rcpp::stop("couldn't init tnt_stream object");
+    }
+
+    msgpack::packer<msgpack::sbuffer> pk(&buff);
+
+    for (R_xlen_t start = 0; start < nrows; start += batch_size) {
+        auto end = std::min(nrows, start + static_cast<R_xlen_t>(batch_size));
+
+        reset_requests(requests);
+        requests->reqid = conn->stream->reqid;
+        PendingReplies pending(conn, requests->reqid);
+
+        for (R_xlen_t i = start; i < end; i++) {
+            buff.clear();
+            encoder.pack_row(i, pk);
+            tnt_object_as(tuple.get(), buff.data(), buff.size());
+
+            auto rc = op == TNT_OP_INSERT ? tnt_insert(requests.get(), space_id, tuple.get())
+                                          : tnt_replace(requests.get(), space_id, tuple.get());
+            check_tnt_api_rc(rc, op == TNT_OP_INSERT ? "tnt_insert()" : "tnt_replace()");
         }
 
-        if (!single_op.containsElementNamed("arg")) {
-            Rcpp::stop("missied 'arg' value which is a mandatory option for update operation description.");
+        conn->stream->reqid = requests->reqid;
+        conn->write_requests(requests);
+        pending.sent = end - start;
+
+        while (pending.received < pending.sent) {
+            auto k = pending.received++;
+            auto reply = conn->read_reply(pending.sync(k));
+            if (reply->code != 0) {
+                status[start + k] = false;
+                errors[start + k] = reply_error_msg(reply.get());
+            }
+        }
+
+        Rcpp::checkUserInterrupt();
+    }
+
+    status.attr("errors") = errors;
+
+    return (status);
+}
+
+TntReplyPtr Tarantool::read_reply(uint64_t sync)
+{
+    auto reply = conn->read_reply(sync);
+    if (reply->code != 0) {
+        Rcpp::stop(reply_error_msg(reply.get()));
+    }
+
+    return (reply);
+}
+
+// Reply is read into the connection's arena, which is valid until the next
+// reply is read, see Connection::read_reply_view().
+const TntReply *Tarantool::read_reply_view(uint64_t sync)
+{
+    auto reply = conn->read_reply_view(sync);
+    if (reply->code != 0) {
+        Rcpp::stop(reply_error_msg(reply));
+    }
+
+    return (reply);
+}
+
+SEXP Tarantool::read_server_reply(uint64_t sync)
+{
+    auto reply = read_reply_view(sync);
+    auto size = reply->data && reply->data_end ? reply->data_end - reply->data : 0;
+
+    return (unpack_view(reply->data, size));
+}
+
+SEXP Tarantool::read_columns_reply(uint64_t sync)
+{
+    auto reply = read_reply_view(sync);
+    if (reply->data == nullptr || reply->data_end == nullptr) {
+        Rcpp::stop("reply has no data");
+    }
+
+    return (unpack_columns(conn->arena.unpack(reply->data, reply->data_end - reply->data)));
+}
+
+// Converts the data with the msgpack objects allocated in the arena.
+SEXP Tarantool::unpack_view(const char *data, size_t size)
+{
+    if (size == 0) {
+        return (R_NilValue);
+    }
+
+    return (unpack_object(conn->arena.unpack(data, size)));
+}
+
+static void reset_requests(TntStreamPtr &requests)
+{
+    TNT_SBUF_SIZE(requests.get()) = 0;
+    requests->wrcnt = 0;
+}
+
+static SEXP unpack_reply(const TntReply *reply)
+{
+    SEXP result = R_NilValue;
+
+    if (reply->data && reply->data_end) {
+        msgpack::unpacked unpacked;
+        unpack_referenced(unpacked, reply->data, reply->data_end - reply->data);
+
+        result = unpack_object(unpacked.get());
+    }
+
+    return result;
+}
+
+static bool is_lazy(const Rcpp::List &params)
+{
+    return (params.containsElementNamed("lazy") && Rcpp::as<bool>(params["lazy"]));
+}
+
+// Number of pipelined requests in flight, the depth element of params.
+static int get_depth(const Rcpp::List &params)
+{
+    int depth = kDefaultManyDepth;
+
+    if (params.containsElementNamed("depth")) {
+        depth = Rcpp::as<int>(params["depth"]);
+        if (depth <= 0) {
+            Rcpp::stop("depth must be a positive integer");
         }
+    }
+
+    return (depth);
+}
+
+static void get_select_params(const Rcpp::List &params, uint32_t &index, uint32_t &limit, uint32_t &offset, int &iterator)
+{
+    if (params.containsElementNamed("index")) {
+        index = Rcpp::as<uint32_t>(params["index"]);
+    }
+
+    if (params.containsElementNamed("limit")) {
+        limit = Rcpp::as<uint32_t>(params["limit"]);
+    }
+
+    if (params.containsElementNamed("offset")) {
+        offset = Rcpp::as<uint32_t>(params["offset"]);
+    }
+
+    if (params.containsElementNamed("iterator")) {
+        iterator = Rcpp::as<int>(params["iterator"]);
+    }
+}
+
+// Checks the description of an update operation: a list with field, op and,
+// unless it's a part of a template (see UpdateOpsTemplate), arg elements.
+// Returns the operator and stores the field number to field_no.
+static char check_update_op(SEXP desc, bool needs_arg, uint32_t &field_no)
+{
+    if (TYPEOF(desc) != VECSXP) {
+        Rcpp::stop("invalid structure of update operation description.");
+    }
+
+    Rcpp::List single_op(desc);
+
+    if (!single_op.containsElementNamed("field")) {
+        Rcpp::stop("missed 'field' value which is a mandatory option for update operation description.");
+    }
+
+    field_no = Rcpp::as<uint32_t>(single_op["field"]);
+
+    if (!single_op.containsElementNamed("op")) {
+        Rcpp::stop("missed 'op' value which is a mandatory option for update operation description.");
+    }
+
+    if (TYPEOF(single_op["op"]) != STRSXP) {
+        Rcpp::stop("update operator must be a string value.");
+    }
+
+    auto s = Rcpp::as<std::string>(single_op["op"]);
+    if (s.size() != 1 || valid_update_operators.find(s[0]) == valid_update_operators.end()) {
+        Rcpp::stop("invalid update operator: %s", s.c_str());
+    }
+
+    if (needs_arg && !single_op.containsElementNamed("arg")) {
+        Rcpp::stop("missed 'arg' value which is a mandatory option for update operation description.");
+    }
 
+    return (s[0]);
+}
+
+TntStreamPtr Tarantool::pack_update_ops(const Rcpp::List &x)
+{
+    int rc;
+    TntStreamPtr ops = TntStreamPtr(tnt_update_container(NULL));
+
+    for (const auto &v : x) {
+        uint32_t field_no;
+        auto op_value = check_update_op(v, true, field_no);
+
+        auto single_op = Rcpp::as<Rcpp::List>(v);
         auto arg = single_op["arg"];
         auto arg_type = TYPEOF(arg);
 
         if (op_value == '+' || op_value == '-') {
-            if (arg_type == REALSXP) {
+            if (is_integer64(arg)) {
+                rc = tnt_update_arith_int(ops.get(), field_no, op_value, integer64_value(arg));
+                check_tnt_api_rc(rc, "tnt_update_arith_int()");
+            } else if (arg_type == REALSXP) {
                 auto arg_value = Rcpp::as<double>(arg);
                 rc = tnt_update_arith_double(ops.get(), field_no, op_value, arg_value);
                 check_tnt_api_rc(rc, "tnt_update_arith_double()");
@@ -695,14 +1235,19 @@ TntStreamPtr Tarantool::pack_update_ops(const Rcpp::List &x)
     return (ops);
 }
 
-void Tarantool::check_tnt_api_rc(int rc, const char *function_name)
+TntStreamPtr Tarantool::pack_buffer(SEXP e)
 {
-    if (rc == -1) {
-        Rcpp::stop("'%s' function failed.", function_name);
-    }
+    return (::pack_buffer(buff, e));
 }
 
-TntStreamPtr Tarantool::pack_buffer(SEXP e)
+static TntStreamPtr pack_buffer(msgpack::sbuffer &buff, SEXP e)
+{
+    pack_value(buff, e);
+
+    return (TntStreamPtr(tnt_object_as(NULL, const_cast<char *>(buff.data()), buff.size())));
+}
+
+static void pack_value(msgpack::sbuffer &buff, SEXP e)
 {
     Rcpp::List data;
 
@@ -719,8 +1264,6 @@ TntStreamPtr Tarantool::pack_buffer(SEXP e)
     msgpack::packer<msgpack::sbuffer> pk(&buff);
 
     pack_list(data, pk);
-
-    return (TntStreamPtr(tnt_object_as(NULL, const_cast<char *>(buff.data()), buff.size())));
 }
 
 TntStreamPtr Tarantool::pack_update_arg(SEXP e)
@@ -743,88 +1286,1722 @@ TntStreamPtr Tarantool::pack_update_arg(SEXP e)
     return (TntStreamPtr(tnt_object_as(NULL, const_cast<char *>(update_op_buff.data()), update_op_buff.size())));
 }
 
-std::string Tarantool::sexp_type_name(SEXP x)
-{
-    switch (TYPEOF(x)) {
-    case NILSXP:
-        return "NILSXP";
-    case SYMSXP:
-        return "SYMSXP";
-    case LISTSXP:
-        return "LISTSXP";
-    case CLOSXP:
-        return "CLOSXP";
-    case ENVSXP:
-        return "ENVSXP";
-    case PROMSXP:
-        return "PROMSXP";
-    case LANGSXP:
-        return "LANGSXP";
-    case SPECIALSXP:
-        return "SPECIALSXP";
-    case BUILTINSXP:
-        return "BUILTINSXP";
-    case CHARSXP:
-        return "CHARSXP";
-    case LGLSXP:
-        return "LGLSXP";
-    case INTSXP:
-        return "INTSXP";
-    case REALSXP:
-        return "REALSXP";
-    case CPLXSXP:
-        return "CPLXSXP";
-    case STRSXP:
-        return "STRSXP";
-    case DOTSXP:
-        return "DOTSXP";
-    case ANYSXP:
-        return "ANYSXP";
-    case VECSXP:
-        return "VECSXP";
-    case EXPRSXP:
-        return "EXPRSXP";
-    case BCODESXP:
-        return "BCODESXP";
-    case EXTPTRSXP:
-        return "EXTPTRSXP";
-    case WEAKREFSXP:
-        return "WEAKREFSXP";
-    case S4SXP:
-        return "S4SXP";
-    case RAWSXP:
-        return "RAWSXP";
-    default:
-        return "<unknown>";
-    }
-}
-
-std::string Tarantool::msgpack_type_name(int type)
-{
-    switch (type) {
-    case msgpack::type::NIL:
-        return "NIL";
-    case msgpack::type::BOOLEAN:
-        return "BOOLEAN";
-    case msgpack::type::POSITIVE_INTEGER:
-        return "POSITIVE_INTEGER";
-    case msgpack::type::NEGATIVE_INTEGER:
-        return "NEGATIVE_INTEGER";
-    case msgpack::type::FLOAT:
-        return "FLOAT";
-    case msgpack::type::STR:
-        return "STR";
-    case msgpack::type::BIN:
-        return "BIN";
-    case msgpack::type::ARRAY:
-        return "ARRAY";
-    case msgpack::type::MAP:
-        return "MAP";
-    case msgpack::type::EXT:
-        return "EXT";
-    default:
-        return "<unknown>";
+// Accumulates requests on the client side and sends them to the server with
+// a single write. Replies are read in one go and matched to the requests by
+// their sync id, so the round trip is paid once per batch, not per request.
+class TarantoolPipeline
+{
+public:
+    explicit TarantoolPipeline(ConnectionPtr conn)
+        : conn(conn)
+        , requests(tnt_buf(NULL))
+    {
+        if (!requests) {
+            Rcpp::stop("couldn't init tnt_buf object");
+        }
+    }
+
+    int insert(SEXP space, SEXP tpl)
+    {
+        auto space_id = conn->get_space_id(space);
+        TntStreamPtr packed_tuple = pack_buffer(buff, tpl);
+
+        conn->invalidate_cache(space_id);
+        auto sync = begin_request();
+        auto rc = tnt_insert(requests.get(), space_id, packed_tuple.get());
+        check_tnt_api_rc(rc, "tnt_insert()");
+
+        return (end_request(sync));
+    }
+
+    int replace(SEXP space, SEXP tpl)
+    {
+        auto space_id = conn->get_space_id(space);
+        TntStreamPtr packed_tuple = pack_buffer(buff, tpl);
+
+        conn->invalidate_cache(space_id);
+        auto sync = begin_request();
+        auto rc = tnt_replace(requests.get(), space_id, packed_tuple.get());
+        check_tnt_api_rc(rc, "tnt_replace()");
+
+        return (end_request(sync));
+    }
+
+    int select(SEXP space, SEXP key, const Rcpp::List params)
+    {
+        auto space_id = conn->get_space_id(space);
+        TntStreamPtr packed_key = pack_buffer(buff, key);
+
+        uint32_t index = 0;
+        uint32_t limit = std::numeric_limits<uint32_t>::max();
+        uint32_t offset = 0;
+        int iterator = TNT_ITER_EQ;
+
+        get_select_params(params, index, limit, offset, iterator);
+
+        auto sync = begin_request();
+        auto rc = tnt_select(requests.get(), space_id, index, limit, offset, iterator, packed_key.get());
+        check_tnt_api_rc(rc, "tnt_select()");
+
+        return (end_request(sync));
+    }
+
+    int call(const std::string &func, SEXP args)
+    {
+        TntStreamPtr packed_args = pack_buffer(buff, args);
+
+        auto sync = begin_request();
+        auto rc = tnt_call(requests.get(), func.c_str(), func.size(), packed_args.get());
+        check_tnt_api_rc(rc, "tnt_call()");
+
+        return (end_request(sync));
+    }
+
+    int size()
+    {
+        return (static_cast<int>(syncs.size()));
+    }
+
+    SEXP execute();
+
+private:
+    ConnectionPtr conn;
+    TntStreamPtr requests;
+    std::vector<uint64_t> syncs;
+    msgpack::sbuffer buff;
+
+    uint64_t begin_request();
+    int end_request(uint64_t sync);
+    void reset();
+};
+
+uint64_t TarantoolPipeline::begin_request()
+{
+    // Requests share the sync id sequence with the connection, so replies
+    // can't be confused with the ones to the regular (non pipelined) calls.
+    requests->reqid = conn->stream->reqid;
+
+    return (requests->reqid);
+}
+
+int TarantoolPipeline::end_request(uint64_t sync)
+{
+    conn->stream->reqid = requests->reqid;
+    syncs.push_back(sync);
+
+    return (size());
+}
+
+void TarantoolPipeline::reset()
+{
+    reset_requests(requests);
+    syncs.clear();
+}
+
+SEXP TarantoolPipeline::execute()
+{
+    auto n = syncs.size();
+    if (n == 0) {
+        return (Rcpp::List::create());
+    }
+
+    std::vector<uint64_t> sent;
+    sent.swap(syncs);
+
+    try {
+        conn->write_requests(requests);
+    } catch (...) {
+        reset();
+        throw;
+    }
+    reset();
+
+    std::vector<TntReplyPtr> replies(n);
+    size_t i = 0;
+    try {
+        for (; i < n; i++) {
+            replies[i] = conn->read_reply(sent[i]);
+        }
+    } catch (...) {
+        // the request which failed was discarded by read_reply() if it timed
+        // out, the ones after it are dropped when they arrive
+        for (size_t j = i + 1; j < n; j++) {
+            conn->discard_reply(sent[j]);
+        }
+        throw;
+    }
+
+    Rcpp::List result(n);
+    for (i = 0; i < n; i++) {
+        if (replies[i]->code != 0) {
+            Rcpp::stop("request %d failed: %s", static_cast<int>(i + 1), reply_error_msg(replies[i].get()).c_str());
+        }
+        result[i] = unpack_reply(replies[i].get());
+    }
+
+    return (result);
+}
+
+// Handle of the request sent with one of the async_*() methods. Reply to the
+// request is read by value(), or earlier by poll() of the connection, and
+// kept in the handle once converted.
+class TarantoolFuture
+{
+public:
+    TarantoolFuture(ConnectionPtr conn, uint64_t sync)
+        : conn(conn)
+        , sync(sync)
+    {
+    }
+
+    ~TarantoolFuture()
+    {
+        if (!resolved) {
+            conn->discard_reply(sync);
+        }
+    }
+
+    bool ready()
+    {
+        return (resolved || conn->has_reply(sync));
+    }
+
+    SEXP value()
+    {
+        if (!resolved) {
+            auto reply = conn->read_reply(sync);
+            resolved = true;
+            if (reply->code != 0) {
+                error = reply_error_msg(reply.get());
+                failed = true;
+            } else {
+                result = unpack_reply(reply.get());
+            }
+        }
+
+        if (failed) {
+            Rcpp::stop(error);
+        }
+
+        return (result);
+    }
+
+private:
+    ConnectionPtr conn;
+    uint64_t sync;
+    bool resolved = false;
+    bool failed = false;
+    std::string error;
+    Rcpp::RObject result;
+};
+
+// Request with the header and the leading part of the body encoded once, when
+// it's prepared. Executing it only takes patching length and sync id in place
+// and sending the prefix along with the encoded arguments.
+class PreparedRequest
+{
+public:
+    PreparedRequest(ConnectionPtr conn, uint32_t code)
+        : conn(conn)
+    {
+        // length and sync are encoded as uint32 and uint64 regardless of
+        // their values, so they can be overwritten without moving anything
+        const char header[] = { '\xce', 0, 0, 0, 0, '\x82', TNT_CODE, static_cast<char>(code), TNT_SYNC, '\xcf', 0, 0, 0, 0, 0, 0, 0, 0 };
+        prefix.assign(header, header + sizeof(header));
+    }
+
+    RequestMetrics &metrics()
+    {
+        return (conn->metrics);
+    }
+
+    void append(const msgpack::sbuffer &body)
+    {
+        prefix.insert(prefix.end(), body.data(), body.data() + body.size());
+    }
+
+    SEXP execute(const msgpack::sbuffer &args)
+    {
+        auto reply = conn->read_reply(send(args));
+        if (reply->code != 0) {
+            Rcpp::stop(reply_error_msg(reply.get()));
+        }
+
+        return (unpack_reply(reply.get()));
     }
+
+    // Sends the request without waiting for the reply, returns its sync id.
+    uint64_t send(const msgpack::sbuffer &args)
+    {
+        auto sync = conn->next_sync();
+
+        uint32_t len = prefix.size() - kLengthSize + args.size();
+        for (int i = 0; i < 4; i++) {
+            prefix[1 + i] = static_cast<char>((len >> (24 - 8 * i)) & 0xff);
+        }
+        for (int i = 0; i < 8; i++) {
+            prefix[kSyncOffset + i] = static_cast<char>((sync >> (56 - 8 * i)) & 0xff);
+        }
+
+        struct iovec iov[2];
+        iov[0].iov_base = prefix.data();
+        iov[0].iov_len = prefix.size();
+        iov[1].iov_base = const_cast<char *>(args.data());
+        iov[1].iov_len = args.size();
+
+        auto rc = conn->stream->writev(conn->stream.get(), iov, 2);
+        if (rc == -1) {
+            Rcpp::stop(conn->mk_error_msg());
+        }
+        conn->stream->reqid++;
+
+        conn->flush();
+
+        return (sync);
+    }
+
+private:
+    static const size_t kLengthSize = 5;
+    static const size_t kSyncOffset = 10;
+
+    ConnectionPtr conn;
+    std::vector<char> prefix;
+};
+
+// Select with space, index, iterator and limit fixed when it's prepared.
+class TarantoolPreparedSelect
+{
+public:
+    TarantoolPreparedSelect(ConnectionPtr conn, uint32_t space_id, uint32_t index, int iterator, uint32_t limit)
+        : request(conn, TNT_OP_SELECT)
+    {
+        msgpack::packer<msgpack::sbuffer> pk(&buff);
+        pk.pack_map(6);
+        pk.pack(static_cast<uint32_t>(TNT_SPACE));
+        pk.pack(space_id);
+        pk.pack(static_cast<uint32_t>(TNT_INDEX));
+        pk.pack(index);
+        pk.pack(static_cast<uint32_t>(TNT_LIMIT));
+        pk.pack(limit);
+        pk.pack(static_cast<uint32_t>(TNT_OFFSET));
+        pk.pack(0);
+        pk.pack(static_cast<uint32_t>(TNT_ITERATOR));
+        pk.pack(iterator);
+        pk.pack(static_cast<uint32_t>(TNT_KEY));
+        request.append(buff);
+    }
+
+    SEXP exec(SEXP key)
+    {
+        RequestTimer timer(request.metrics(), RequestMetrics::Select);
+
+        pack_value(buff, key);
+
+        return (request.execute(buff));
+    }
+
+private:
+    PreparedRequest request;
+    msgpack::sbuffer buff;
+};
+
+// Operations of an update with their fields and operators fixed and the
+// arguments given when they're applied. Operators are checked once and every
+// operation but its argument is encoded upfront.
+class UpdateOpsTemplate
+{
+public:
+    explicit UpdateOpsTemplate(const Rcpp::List &ops_template)
+    {
+        for (const auto &v : ops_template) {
+            uint32_t field_no;
+            auto op = check_update_op(v, false, field_no);
+
+            // [op, field, arg] with everything but the argument encoded
+            msgpack::sbuffer op_prefix;
+            msgpack::packer<msgpack::sbuffer> pk(&op_prefix);
+            pk.pack_array(3);
+            pk.pack(std::string(1, op));
+            pk.pack(field_no);
+
+            ops.push_back(op);
+            op_prefixes.emplace_back(op_prefix.data(), op_prefix.data() + op_prefix.size());
+        }
+    }
+
+    size_t size() const
+    {
+        return (ops.size());
+    }
+
+    char op(size_t i) const
+    {
+        return (ops[i]);
+    }
+
+    // Packs [op, field, without the argument.
+    void pack_prefix(size_t i, msgpack::sbuffer &buff) const
+    {
+        buff.write(op_prefixes[i].data(), op_prefixes[i].size());
+    }
+
+    // Packs argument of the operator from an R value, checking its type.
+    static void pack_arg(msgpack::packer<msgpack::sbuffer> &pk, char op, SEXP arg);
+
+private:
+    std::vector<char> ops;
+    std::vector<std::string> op_prefixes;
+};
+
+void UpdateOpsTemplate::pack_arg(msgpack::packer<msgpack::sbuffer> &pk, char op, SEXP arg)
+{
+    auto arg_type = TYPEOF(arg);
+
+    if (op == '+' || op == '-') {
+        if (is_integer64(arg)) {
+            pk.pack(integer64_value(arg));
+        } else if (arg_type == REALSXP) {
+            pk.pack(Rcpp::as<double>(arg));
+        } else if (arg_type == INTSXP) {
+            pk.pack(Rcpp::as<int64_t>(arg));
+        } else {
+            Rcpp::stop("invalid data type for this type of argument");
+        }
+    } else if (op == '&' || op == '|' || op == '^') {
+        if (arg_type != INTSXP) {
+            Rcpp::stop("invalid operator for this type of argument");
+        }
+        auto arg_value = Rcpp::as<int64_t>(arg);
+        if (arg_value < 0) {
+            Rcpp::stop("bit operator requires argument to be non negative integer");
+        }
+        pk.pack(static_cast<uint64_t>(arg_value));
+    } else if (op == '#') {
+        if (arg_type != INTSXP && arg_type != REALSXP) {
+            Rcpp::stop("invalid operator for this type of argument");
+        }
+        auto arg_value = Rcpp::as<int64_t>(arg);
+        if (arg_value < 0) {
+            Rcpp::stop("argument for delete operator must be non negative integer");
+        }
+        pk.pack(static_cast<uint64_t>(arg_value));
+    } else if (arg_type == VECSXP) {
+        pack_list(Rcpp::as<Rcpp::List>(arg), pk);
+    } else {
+        Rcpp::List data = Rcpp::List::create(arg);
+        auto it = data.begin();
+        pack_elem(it, pk);
+    }
+}
+
+// Arguments of the template's operations for many rows, given as a data.frame
+// or a list of vectors with a column per operation. Column types and values
+// are checked against the operators once, when the encoder is created, so
+// that rows are encoded straight from the vectors.
+class UpdateArgsEncoder
+{
+public:
+    UpdateArgsEncoder(const UpdateOpsTemplate &tpl, SEXP args);
+
+    R_xlen_t nrows() const
+    {
+        return (rows);
+    }
+
+    // Packs the array of operations with the arguments of the row.
+    void pack_ops(R_xlen_t row, msgpack::sbuffer &buff) const;
+
+private:
+    const UpdateOpsTemplate &tpl;
+    std::vector<SEXP> columns;
+    // encoders of the arguments of '=' and '!', which can be of any type
+    std::vector<std::unique_ptr<VectorEncoder>> encoders;
+    R_xlen_t rows = 0;
+
+    void check_column(size_t j) const;
+};
+
+UpdateArgsEncoder::UpdateArgsEncoder(const UpdateOpsTemplate &tpl, SEXP args)
+    : tpl(tpl)
+{
+    if (TYPEOF(args) != VECSXP) {
+        Rcpp::stop("arguments must be a data.frame or a list of vectors, got %s", sexp_type_name(args).c_str());
+    }
+    if (static_cast<size_t>(XLENGTH(args)) != tpl.size()) {
+        Rcpp::stop("expected %d columns of arguments of update operations, got %d", static_cast<int>(tpl.size()),
+            static_cast<int>(XLENGTH(args)));
+    }
+
+    columns.reserve(tpl.size());
+    encoders.reserve(tpl.size());
+    for (size_t j = 0; j < tpl.size(); j++) {
+        SEXP column = VECTOR_ELT(args, j);
+        if (j == 0) {
+            rows = XLENGTH(column);
+        } else if (XLENGTH(column) != rows) {
+            Rcpp::stop("column %d of arguments has %d values, expected %d", static_cast<int>(j + 1),
+                static_cast<int>(XLENGTH(column)), static_cast<int>(rows));
+        }
+        columns.push_back(column);
+        encoders.emplace_back();
+
+        auto op = tpl.op(j);
+        if (TYPEOF(column) != VECSXP && op != '+' && op != '-' && op != '&' && op != '|' && op != '^' && op != '#') {
+            encoders.back().reset(new VectorEncoder(column));
+            if (encoders.back()->encoding() == VectorEncoder::Encoding::Unsupported) {
+                Rcpp::stop("unsupported data type of column %d: %s", static_cast<int>(j + 1), sexp_type_name(column).c_str());
+            }
+        } else if (TYPEOF(column) != VECSXP) {
+            check_column(j);
+        }
+    }
+}
+
+void UpdateArgsEncoder::check_column(size_t j) const
+{
+    SEXP column = columns[j];
+    auto type = TYPEOF(column);
+    auto op = tpl.op(j);
+    auto column_no = static_cast<int>(j + 1);
+
+    if (op == '+' || op == '-') {
+        if (type != INTSXP && type != REALSXP) {
+            Rcpp::stop("invalid data type of column %d for operator %c: %s", column_no, op, sexp_type_name(column).c_str());
+        }
+    } else if (op == '&' || op == '|' || op == '^') {
+        if (type != INTSXP) {
+            Rcpp::stop("invalid data type of column %d for operator %c: %s", column_no, op, sexp_type_name(column).c_str());
+        }
+    } else if (type != INTSXP && (type != REALSXP || is_integer64(column))) {
+        Rcpp::stop("invalid data type of column %d for operator %c: %s", column_no, op, sexp_type_name(column).c_str());
+    }
+
+    bool is_int64 = is_integer64(column);
+    for (R_xlen_t i = 0; i < rows; i++) {
+        bool missing;
+        bool negative;
+        if (type == INTSXP) {
+            missing = INTEGER(column)[i] == NA_INTEGER;
+            negative = INTEGER(column)[i] < 0;
+        } else if (is_int64) {
+            missing = integer64_value(column, i) == std::numeric_limits<int64_t>::min();
+            negative = false;
+        } else {
+            missing = ISNAN(REAL(column)[i]);
+            negative = REAL(column)[i] < 0;
+        }
+
+        if (missing) {
+            Rcpp::stop("missing argument of operator %c in row %d", op, static_cast<int>(i + 1));
+        }
+        if (negative && op != '+' && op != '-') {
+            Rcpp::stop("argument of operator %c must be non negative integer, row %d", op, static_cast<int>(i + 1));
+        }
+    }
+}
+
+void UpdateArgsEncoder::pack_ops(R_xlen_t row, msgpack::sbuffer &buff) const
+{
+    msgpack::packer<msgpack::sbuffer> pk(&buff);
+    pk.pack_array(tpl.size());
+
+    for (size_t j = 0; j < columns.size(); j++) {
+        tpl.pack_prefix(j, buff);
+
+        SEXP column = columns[j];
+        auto op = tpl.op(j);
+        if (TYPEOF(column) == VECSXP) {
+            // list column, its elements are checked as they're packed
+            UpdateOpsTemplate::pack_arg(pk, op, VECTOR_ELT(column, row));
+        } else if (encoders[j]) {
+            encoders[j]->pack(row, pk);
+        } else if (TYPEOF(column) == INTSXP) {
+            auto value = INTEGER(column)[row];
+            if (op == '+' || op == '-') {
+                pk.pack(static_cast<int64_t>(value));
+            } else {
+                pk.pack(static_cast<uint64_t>(value));
+            }
+        } else if (is_integer64(column)) {
+            pk.pack(integer64_value(column, row));
+        } else if (op == '#') {
+            pk.pack(static_cast<uint64_t>(REAL(column)[row]));
+        } else {
+            pk.pack(REAL(column)[row]);
+        }
+    }
+}
+
+// Update of the tuple with the given primary key, with the fields and
+// operators of its operations fixed when it's prepared. Arguments of the
+// operations are passed on every call.
+class TarantoolPreparedUpdate
+{
+public:
+    TarantoolPreparedUpdate(ConnectionPtr conn, uint32_t space_id, const Rcpp::List &ops_template)
+        : conn(conn)
+        , space_id(space_id)
+        , request(conn, TNT_OP_UPDATE)
+        , tpl(ops_template)
+    {
+        msgpack::packer<msgpack::sbuffer> pk(&buff);
+        pk.pack_map(4);
+        pk.pack(static_cast<uint32_t>(TNT_SPACE));
+        pk.pack(space_id);
+        pk.pack(static_cast<uint32_t>(TNT_INDEX));
+        pk.pack(0);
+        pk.pack(static_cast<uint32_t>(TNT_KEY));
+        request.append(buff);
+    }
+
+    SEXP exec(SEXP key, const Rcpp::List args)
+    {
+        RequestTimer timer(conn->metrics, RequestMetrics::Update);
+
+        if (static_cast<size_t>(args.size()) != tpl.size()) {
+            Rcpp::stop("expected %d arguments of update operations, got %d", static_cast<int>(tpl.size()), static_cast<int>(args.size()));
+        }
+
+        pack_value(buff, key);
+
+        msgpack::packer<msgpack::sbuffer> pk(&buff);
+        pk.pack(static_cast<uint32_t>(TNT_TUPLE));
+        pk.pack_array(tpl.size());
+        for (size_t i = 0; i < tpl.size(); i++) {
+            tpl.pack_prefix(i, buff);
+            UpdateOpsTemplate::pack_arg(pk, tpl.op(i), args[i]);
+        }
+
+        conn->invalidate_cache(space_id);
+
+        return (request.execute(buff));
+    }
+
+private:
+    ConnectionPtr conn;
+    uint32_t space_id;
+    PreparedRequest request;
+    UpdateOpsTemplate tpl;
+    msgpack::sbuffer buff;
+};
+
+static SEXP read_sql_reply(ConnectionPtr &conn, uint64_t sync)
+{
+    auto reply = conn->read_reply_view(sync);
+    if (reply->code != 0) {
+        Rcpp::stop(reply_error_msg(reply));
+    }
+
+    auto result = SqlReply::parse(reply, conn->arena);
+    if (!result.format) {
+        // DML or DDL statement, there is no telling which spaces it changed
+        conn->invalidate_cache();
+    }
+
+    return (sql_result(result));
+}
+
+// Unprepares the dropped statements (see Connection::dropped_sql_statements),
+// the replies aren't waited for.
+static void unprepare_dropped_sql_statements(ConnectionPtr &conn)
+{
+    if (conn->dropped_sql_statements.empty()) {
+        return;
+    }
+
+    std::vector<uint64_t> ids;
+    ids.swap(conn->dropped_sql_statements);
+
+    NestedRequest nested(conn->metrics);
+
+    PreparedRequest request(conn, kSqlPrepare);
+    msgpack::sbuffer buff;
+    for (auto id : ids) {
+        buff.clear();
+        pack_sql_unprepare(buff, id);
+        conn->discard_reply(request.send(buff));
+    }
+}
+
+// Prepares the SQL statement on the server unless it was already prepared
+// through the connection.
+static SqlStatement &prepare_sql_statement(ConnectionPtr &conn, const std::string &sql)
+{
+    unprepare_dropped_sql_statements(conn);
+
+    auto it = conn->sql_statements.find(sql);
+    if (it != conn->sql_statements.end()) {
+        return (it->second);
+    }
+
+    msgpack::sbuffer buff;
+    pack_sql_prepare(buff, sql);
+
+    // the statement is prepared by exec() when the connection was
+    // reestablished, which isn't accounted as the execution
+    NestedRequest nested(conn->metrics);
+
+    PreparedRequest request(conn, kSqlPrepare);
+    auto reply = conn->read_reply_view(request.send(buff));
+    if (reply->code != 0) {
+        Rcpp::stop(reply_error_msg(reply));
+    }
+
+    auto prepared = SqlReply::parse(reply, conn->arena);
+    if (!prepared.has_stmt_id) {
+        Rcpp::stop("unexpected server reply: no id of the prepared statement");
+    }
+
+    SqlStatement stmt{ prepared.stmt_id, prepared.bind_count, 0 };
+
+    return (conn->sql_statements.emplace(sql, stmt).first->second);
+}
+
+// Forgets the SQL statement and unprepares it on the server, right away or,
+// when called from a destructor, along with the next SQL request: the
+// destructors run whenever R collects garbage, requests mustn't be sent then.
+static void unprepare_sql_statement(ConnectionPtr &conn, const std::string &sql, bool now)
+{
+    auto it = conn->sql_statements.find(sql);
+    if (it == conn->sql_statements.end()) {
+        return;
+    }
+
+    auto id = it->second.id;
+    conn->sql_statements.erase(it);
+
+    if (!now) {
+        conn->dropped_sql_statements.push_back(id);
+        return;
+    }
+
+    unprepare_dropped_sql_statements(conn);
+
+    msgpack::sbuffer buff;
+    pack_sql_unprepare(buff, id);
+
+    PreparedRequest request(conn, kSqlPrepare);
+    auto reply = conn->read_reply_view(request.send(buff));
+    if (reply->code != 0) {
+        Rcpp::stop(reply_error_msg(reply));
+    }
+}
+
+// SQL statement prepared on the server, which is executed by its id, so
+// that the server doesn't parse it again. It's prepared once more if the
+// connection was reestablished or the statement was unprepared since. The
+// statement is unprepared when the last of the objects using it is, or is
+// garbage collected.
+class TarantoolPreparedSql
+{
+public:
+    TarantoolPreparedSql(ConnectionPtr conn, const std::string &sql)
+        : conn(conn)
+        , sql(sql)
+        , request(conn, kSqlExecute)
+    {
+        nparams = acquire().bind_count;
+    }
+
+    ~TarantoolPreparedSql()
+    {
+        release(false);
+    }
+
+    SEXP exec(SEXP params)
+    {
+        RequestTimer timer(conn->metrics, RequestMetrics::Execute);
+
+        auto &stmt = acquire();
+
+        buff.clear();
+        pack_sql_execute(buff, stmt.id, params);
+
+        return (read_sql_reply(conn, request.send(buff)));
+    }
+
+    int bind_count() const
+    {
+        return (static_cast<int>(nparams));
+    }
+
+    void unprepare()
+    {
+        release(true);
+    }
+
+private:
+    ConnectionPtr conn;
+    std::string sql;
+    uint32_t nparams;
+    PreparedRequest request;
+    msgpack::sbuffer buff;
+
+    // whether the object is counted as a user of the statement prepared in
+    // the given session of the connection
+    bool held = false;
+    uint64_t session = 0;
+
+    SqlStatement &acquire()
+    {
+        auto &stmt = prepare_sql_statement(conn, sql);
+        if (!held || session != conn->session) {
+            stmt.users++;
+            held = true;
+            session = conn->session;
+        }
+
+        return (stmt);
+    }
+
+    void release(bool now)
+    {
+        if (!held) {
+            return;
+        }
+        held = false;
+
+        // statements of the previous sessions are gone with them
+        auto it = conn->sql_statements.find(sql);
+        if (session != conn->session || it == conn->sql_statements.end()) {
+            return;
+        }
+
+        if (--it->second.users == 0) {
+            unprepare_sql_statement(conn, sql, now);
+        }
+    }
+};
+
+SEXP Tarantool::execute(const std::string &sql, SEXP params)
+{
+    RequestTimer timer(conn->metrics, RequestMetrics::Execute);
+
+    unprepare_dropped_sql_statements(conn);
+
+    // statements prepared through the connection are executed by their ids
+    msgpack::sbuffer body;
+    auto it = conn->sql_statements.find(sql);
+    if (it != conn->sql_statements.end()) {
+        pack_sql_execute(body, it->second.id, params);
+    } else {
+        pack_sql_execute(body, sql, params);
+    }
+
+    PreparedRequest request(conn, kSqlExecute);
+
+    return (read_sql_reply(conn, request.send(body)));
+}
+
+SEXP Tarantool::prepare(const std::string &sql)
+{
+    return (Rcpp::internal::make_new_object(new TarantoolPreparedSql(conn, sql)));
+}
+
+SEXP Tarantool::prepare_select(SEXP space, int index, int iterator, SEXP limit)
+{
+    auto space_id = conn->get_space_id(space);
+    uint32_t max_tuples = Rf_isNull(limit) ? std::numeric_limits<uint32_t>::max() : Rcpp::as<uint32_t>(limit);
+
+    return (Rcpp::internal::make_new_object(new TarantoolPreparedSelect(conn, space_id, index, iterator, max_tuples)));
+}
+
+SEXP Tarantool::prepare_update(SEXP space, const Rcpp::List ops_template)
+{
+    auto space_id = conn->get_space_id(space);
+
+    return (Rcpp::internal::make_new_object(new TarantoolPreparedUpdate(conn, space_id, ops_template)));
+}
+
+SEXP Tarantool::modify_many_impl(SEXP space, SEXP rows, const Rcpp::List &ops_template, SEXP args, const Rcpp::List &params, int op)
+{
+    int depth = get_depth(params);
+
+    // the requests are timed as one, from the first of them sent to the last
+    // reply read
+    RequestTimer timer(conn->metrics, op == TNT_OP_UPDATE ? RequestMetrics::Update : RequestMetrics::Upsert);
+
+    auto space_id = conn->get_space_id(space);
+    UpdateOpsTemplate tpl(ops_template);
+    UpdateArgsEncoder ops_encoder(tpl, args);
+    KeyEncoder encoder(rows);
+    auto nrows = encoder.size();
+
+    if (ops_encoder.nrows() != nrows) {
+        Rcpp::stop("expected %d rows of arguments of update operations, got %d", static_cast<int>(nrows),
+            static_cast<int>(ops_encoder.nrows()));
+    }
+
+    conn->invalidate_cache(space_id);
+
+    Rcpp::LogicalVector status(nrows, true);
+    Rcpp::CharacterVector errors(nrows, NA_STRING);
+
+    auto requests = TntStreamPtr(tnt_buf(NULL));
+    auto key = TntStreamPtr(tnt_object(NULL));
+    auto ops = TntStreamPtr(tnt_object(NULL));
+    if (!requests || !key || !ops) {
+        Rcpp::stop("couldn't init tnt_stream object");
+    }
+
+    msgpack::packer<msgpack::sbuffer> pk(&buff);
+    msgpack::sbuffer ops_buff;
+
+    // same as in select_many(), the next chunk of requests is processed by
+    // the server while replies to the previous one are read
+    R_xlen_t chunk = std::max(1, depth / 2);
+    PendingReplies pending(conn, conn->next_sync());
+    R_xlen_t &sent = pending.sent;
+    R_xlen_t &received = pending.received;
+
+    while (received < nrows) {
+        while (sent < nrows && sent - received + chunk <= depth) {
+            auto end = std::min(nrows, sent + chunk);
+
+            reset_requests(requests);
+            requests->reqid = conn->stream->reqid;
+            for (R_xlen_t i = sent; i < end; i++) {
+                buff.clear();
+                encoder.pack_key(i, pk);
+                tnt_object_as(key.get(), buff.data(), buff.size());
+
+                ops_buff.clear();
+                ops_encoder.pack_ops(i, ops_buff);
+                tnt_object_as(ops.get(), ops_buff.data(), ops_buff.size());
+
+                auto rc = op == TNT_OP_UPDATE ? tnt_update(requests.get(), space_id, 0, key.get(), ops.get())
+                                              : tnt_upsert(requests.get(), space_id, key.get(), ops.get());
+                check_tnt_api_rc(rc, op == TNT_OP_UPDATE ? "tnt_update()" : "tnt_upsert()");
+            }
+            conn->stream->reqid = requests->reqid;
+            conn->write_requests(requests);
+
+            sent = end;
+        }
+
+        auto end = std::min(sent, received + chunk);
+        while (received < end) {
+            auto i = received++;
+            auto reply = conn->read_reply_view(pending.sync(i));
+            if (reply->code != 0) {
+                status[i] = NA_LOGICAL;
+                errors[i] = reply_error_msg(reply);
+            } else if (op == TNT_OP_UPDATE) {
+                // update of a missing key returns no tuples
+                const char *p = reply->data;
+                status[i] = p != nullptr && p != reply->data_end && mp_typeof(*p) == MP_ARRAY && mp_decode_array(&p) > 0;
+            }
+        }
+
+        Rcpp::checkUserInterrupt();
+    }
+
+    status.attr("errors") = errors;
+
+    return (status);
+}
+
+SEXP Tarantool::future(uint64_t sync)
+{
+    return (Rcpp::internal::make_new_object(new TarantoolFuture(conn, sync)));
+}
+
+SEXP Tarantool::pipeline()
+{
+    return (Rcpp::internal::make_new_object(new TarantoolPipeline(conn)));
+}
+
+// Set of connections to the replica set. Reads are spread over the replicas,
+// writes and calls go to the leader, which is the first of the hosts. Broken
+// connections are reestablished when they are picked next time, a failed
+// read is retried once on another connection.
+class TarantoolPool
+{
+public:
+    TarantoolPool(Rcpp::CharacterVector uris, int pool_size)
+    {
+        initialize(uris, pool_size, Rcpp::List());
+    }
+
+    TarantoolPool(Rcpp::CharacterVector uris, int pool_size, const Rcpp::List options)
+    {
+        initialize(uris, pool_size, options);
+    }
+
+    SEXP select(SEXP space, SEXP key, const Rcpp::List params)
+    {
+        Rcpp::RObject space_id = resolve_space(space);
+        return (hedged_read([&](Tarantool &t) { return t.send_select(space_id, key, params); },
+            [&](Tarantool &t, uint64_t sync) { return t.receive_select(space_id, sync, params, false); }));
+    }
+
+    SEXP select_df(SEXP space, SEXP key, const Rcpp::List params)
+    {
+        Rcpp::RObject space_id = resolve_space(space);
+        return (hedged_read([&](Tarantool &t) { return t.send_select(space_id, key, params); },
+            [&](Tarantool &t, uint64_t sync) { return t.receive_select(space_id, sync, params, true); }));
+    }
+
+    // Calls a function which only reads data, so it's run on a replica like
+    // selects are (and hedged the same way).
+    SEXP read_call(const std::string &func, SEXP args)
+    {
+        return (hedged_read([&](Tarantool &t) { return t.send_call(func, args); },
+            [&](Tarantool &t, uint64_t sync) { return t.receive(sync); }));
+    }
+
+    SEXP insert(SEXP space, SEXP tpl)
+    {
+        Rcpp::RObject space_id = resolve_space(space);
+        return (write([&](Tarantool &t) { return t.insert(space_id, tpl); }));
+    }
+
+    SEXP replace(SEXP space, SEXP tpl)
+    {
+        Rcpp::RObject space_id = resolve_space(space);
+        return (write([&](Tarantool &t) { return t.replace(space_id, tpl); }));
+    }
+
+    SEXP delete_(SEXP space, SEXP key, const Rcpp::List params)
+    {
+        Rcpp::RObject space_id = resolve_space(space);
+        return (write([&](Tarantool &t) { return t.delete_(space_id, key, params); }));
+    }
+
+    SEXP update(SEXP space, SEXP tpl, const Rcpp::List params)
+    {
+        Rcpp::RObject space_id = resolve_space(space);
+        return (write([&](Tarantool &t) { return t.update(space_id, tpl, params); }));
+    }
+
+    SEXP upsert(SEXP space, SEXP tpl, const Rcpp::List params)
+    {
+        Rcpp::RObject space_id = resolve_space(space);
+        return (write([&](Tarantool &t) { return t.upsert(space_id, tpl, params); }));
+    }
+
+    SEXP call(const std::string &func, SEXP args)
+    {
+        return (write([&](Tarantool &t) { return t.call(func, args); }));
+    }
+
+    SEXP evaluate(const std::string &lua_statement, SEXP args)
+    {
+        return (write([&](Tarantool &t) { return t.evaluate(lua_statement, args); }));
+    }
+
+    SEXP multi_select(Rcpp::List requests);
+
+    SEXP stats();
+
+private:
+    enum class Balancing { RoundRobin, LeastLatency };
+
+    struct Member {
+        std::string host;
+        int port;
+        size_t host_index;
+        bool leader;
+        ConnectionPtr conn;
+        std::unique_ptr<Tarantool> client;
+        double requests = 0;
+        double errors = 0;
+        double reconnects = 0;
+        // smoothed latency of the member's requests in seconds, zero until
+        // the first one is answered
+        double latency = 0;
+        // hedged requests sent to the member and the ones it answered first
+        double hedged = 0;
+        double hedge_wins = 0;
+    };
+
+    std::vector<Member> members;
+    size_t hosts = 0;
+    std::string user;
+    std::string password;
+    ConnectionOptions conn_options;
+    Balancing balancing = Balancing::RoundRobin;
+    size_t next_member = 0;
+
+    // Reads not answered within hedge_delay seconds, or within the
+    // hedge_quantile of the latencies of the reads seen so far, are sent to
+    // another replica as well, the reply which comes first is taken. Negative
+    // values disable hedging.
+    double hedge_delay = -1;
+    double hedge_quantile = -1;
+    // latencies of reads in microseconds
+    Histogram read_latency;
+
+    // space names are resolved once using the schema of the leader
+    ConnectionPtr schema_conn;
+    std::unordered_map<std::string, int> space_ids;
+
+    void initialize(Rcpp::CharacterVector uris, int pool_size, const Rcpp::List &options);
+    SEXP resolve_space(SEXP space);
+    bool ensure_connected(Member &m);
+    Member *pick(bool leader, const Member *exclude);
+    Member *pick_host(size_t host_index);
+
+    static double load(const Member &m);
+    static void record_latency(Member &m, double seconds);
+
+    template <typename F>
+    SEXP run(Member &m, F f);
+
+    template <typename F>
+    SEXP read(F f);
+
+    template <typename F>
+    SEXP write(F f);
+
+    int hedge_delay_ms() const;
+
+    template <typename Send, typename Receive>
+    SEXP hedged_read(Send send, Receive receive);
+
+    template <typename Send, typename Receive>
+    SEXP hedge(Send send, Receive receive, int delay_ms);
+};
+
+void TarantoolPool::initialize(Rcpp::CharacterVector uris, int pool_size, const Rcpp::List &options)
+{
+    if (uris.size() == 0) {
+        Rcpp::stop("at least one host is required");
+    }
+    if (pool_size <= 0) {
+        Rcpp::stop("pool_size must be a positive integer");
+    }
+
+    if (options.containsElementNamed("user")) {
+        user = Rcpp::as<std::string>(options["user"]);
+    }
+
+    if (options.containsElementNamed("password")) {
+        password = Rcpp::as<std::string>(options["password"]);
+    }
+
+    if (options.containsElementNamed("balancing")) {
+        auto b = Rcpp::as<std::string>(options["balancing"]);
+        if (b == "round_robin") {
+            balancing = Balancing::RoundRobin;
+        } else if (b == "least_latency") {
+            balancing = Balancing::LeastLatency;
+        } else {
+            Rcpp::stop("unknown balancing: %s", b.c_str());
+        }
+    }
+
+    conn_options = ConnectionOptions::parse(options);
+
+    if (options.containsElementNamed("hedge_delay")) {
+        hedge_delay = Rcpp::as<double>(options["hedge_delay"]);
+        if (hedge_delay < 0) {
+            Rcpp::stop("hedge_delay must be non-negative");
+        }
+    }
+
+    if (options.containsElementNamed("hedge_quantile")) {
+        hedge_quantile = Rcpp::as<double>(options["hedge_quantile"]);
+        if (hedge_quantile <= 0 || hedge_quantile >= 1) {
+            Rcpp::stop("hedge_quantile must be between 0 and 1");
+        }
+    }
+
+    for (R_xlen_t i = 0; i < uris.size(); i++) {
+        auto uri = Rcpp::as<std::string>(uris[i]);
+        auto host = uri;
+        int port = kDefaultPort;
+
+        auto pos = uri.rfind(':');
+        if (pos != std::string::npos) {
+            host = uri.substr(0, pos);
+            port = std::atoi(uri.c_str() + pos + 1);
+        }
+        if (host.empty() || port <= 0) {
+            Rcpp::stop("invalid host address: %s", uri.c_str());
+        }
+
+        for (int j = 0; j < pool_size; j++) {
+            Member m;
+            m.host = host;
+            m.port = port;
+            m.host_index = i;
+            m.leader = i == 0;
+            members.push_back(std::move(m));
+        }
+    }
+
+    hosts = uris.size();
+
+    // the leader has to be available from the start, replicas are connected
+    // to as soon as they come up
+    schema_conn = std::make_shared<Connection>(members[0].host, members[0].port, user, password, conn_options);
+    members[0].conn = schema_conn;
+    members[0].client.reset(new Tarantool(schema_conn));
+
+    for (auto &m : members) {
+        ensure_connected(m);
+    }
+}
+
+SEXP TarantoolPool::resolve_space(SEXP space)
+{
+    if (TYPEOF(space) != STRSXP) {
+        return (space);
+    }
+
+    auto name = Rcpp::as<std::string>(space);
+    auto it = space_ids.find(name);
+    if (it == space_ids.end()) {
+        it = space_ids.emplace(name, schema_conn->get_space_id(space)).first;
+    }
+
+    return (Rcpp::wrap(it->second));
+}
+
+bool TarantoolPool::ensure_connected(Member &m)
+{
+    try {
+        if (!m.conn) {
+            m.conn = std::make_shared<Connection>(m.host, m.port, user, password, conn_options, false);
+            m.client.reset(new Tarantool(m.conn));
+        } else if (m.conn->broken()) {
+            m.reconnects++;
+            m.conn->reconnect();
+        }
+    } catch (std::exception &) {
+        return (false);
+    }
+
+    return (true);
+}
+
+TarantoolPool::Member *TarantoolPool::pick(bool leader, const Member *exclude)
+{
+    bool have_replicas = false;
+    for (auto &m : members) {
+        have_replicas = have_replicas || !m.leader;
+    }
+
+    bool want_leader = leader || !have_replicas;
+    Member *picked = nullptr;
+    auto n = members.size();
+
+    // members are walked starting from the next one in the round: the first
+    // usable one is taken, or the least loaded one (see load())
+    for (size_t k = 0; k < n; k++) {
+        auto &m = members[(next_member + k) % n];
+        if (&m == exclude || m.leader != want_leader) {
+            continue;
+        }
+        if (picked && (balancing == Balancing::RoundRobin || load(m) >= load(*picked))) {
+            continue;
+        }
+        if (ensure_connected(m)) {
+            picked = &m;
+        }
+    }
+
+    if (!picked && !want_leader) {
+        // all replicas are down, the leader serves reads too
+        for (auto &m : members) {
+            if (m.leader && &m != exclude && ensure_connected(m)) {
+                picked = &m;
+                break;
+            }
+        }
+    }
+
+    if (!picked) {
+        Rcpp::stop("no available connections to %s", want_leader ? "leader" : "replicas");
+    }
+
+    next_member = (static_cast<size_t>(picked - members.data()) + 1) % n;
+
+    return (picked);
+}
+
+// Of the pool's connections to the host the least loaded one (see load()) is
+// taken, so that the shards of multi_select() go to the connections which
+// answered them faster lately. The ones not measured yet are tried first.
+TarantoolPool::Member *TarantoolPool::pick_host(size_t host_index)
+{
+    Member *picked = nullptr;
+
+    for (auto &m : members) {
+        if (m.host_index != host_index || (picked && load(m) >= load(*picked))) {
+            continue;
+        }
+        if (ensure_connected(m)) {
+            picked = &m;
+        }
+    }
+
+    if (!picked) {
+        Rcpp::stop("no available connections to host %d", static_cast<int>(host_index + 1));
+    }
+
+    return (picked);
+}
+
+// Weight of the latency in the smoothed latency of a member.
+static const double kLatencyEwmaWeight = 0.2;
+
+// Requests are synchronous, so the latency of the member's recent requests
+// is what tells a slow or busy one. It's scaled by the replies the connection
+// still awaits (late replies to hedged requests), as the next request waits
+// for them to be read as well. Members which haven't answered yet have zero
+// load, so that every one gets measured.
+double TarantoolPool::load(const Member &m)
+{
+    auto pending = m.conn ? m.conn->stream->wrcnt : 0;
+
+    return (m.latency * (1 + pending));
+}
+
+void TarantoolPool::record_latency(Member &m, double seconds)
+{
+    m.latency = m.latency == 0 ? seconds : m.latency + kLatencyEwmaWeight * (seconds - m.latency);
+}
+
+template <typename F>
+SEXP TarantoolPool::run(Member &m, F f)
+{
+    m.requests++;
+    auto started = std::chrono::steady_clock::now();
+
+    try {
+        SEXP result = f(*m.client);
+        record_latency(m, std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+        return (result);
+    } catch (...) {
+        m.errors++;
+        throw;
+    }
+}
+
+template <typename F>
+SEXP TarantoolPool::read(F f)
+{
+    auto m = pick(false, nullptr);
+
+    try {
+        return (run(*m, f));
+    } catch (std::exception &) {
+        if (!m->conn->broken()) {
+            throw;
+        }
+    }
+
+    // reads are safe to repeat
+    return (run(*pick(false, m), f));
+}
+
+template <typename F>
+SEXP TarantoolPool::write(F f)
+{
+    return (run(*pick(true, nullptr), f));
+}
+
+// Hedging by quantile starts once the latencies of this many reads are known.
+static const uint64_t kMinHedgeSamples = 100;
+
+int TarantoolPool::hedge_delay_ms() const
+{
+    if (hedge_delay >= 0) {
+        return (static_cast<int>(hedge_delay * 1000));
+    }
+
+    if (hedge_quantile > 0 && read_latency.count() >= kMinHedgeSamples) {
+        return (static_cast<int>((read_latency.quantile(hedge_quantile) + 999) / 1000));
+    }
+
+    return (-1);
+}
+
+template <typename Send, typename Receive>
+SEXP TarantoolPool::hedged_read(Send send, Receive receive)
+{
+    auto started = std::chrono::steady_clock::now();
+
+    SEXP result;
+    auto delay_ms = hedge_delay_ms();
+    if (delay_ms < 0) {
+        result = read([&](Tarantool &t) { return receive(t, send(t)); });
+    } else {
+        result = hedge(send, receive, delay_ms);
+    }
+
+    read_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count());
+
+    return (result);
+}
+
+// Sends the request to a replica and, if it isn't answered within delay_ms,
+// to another one. Replies are then waited for on both connections, the first
+// one is taken and the other is dropped by its sync id when it arrives.
+template <typename Send, typename Receive>
+SEXP TarantoolPool::hedge(Send send, Receive receive, int delay_ms)
+{
+    struct Attempt {
+        Member *m;
+        uint64_t sync;
+        bool failed;
+    };
+
+    auto started = std::chrono::steady_clock::now();
+    auto deadline = started + std::chrono::milliseconds(static_cast<long long>(conn_options.timeout * 1000));
+
+    Attempt attempts[2];
+    size_t sent = 0;
+
+    auto first = pick(false, nullptr);
+    first->requests++;
+    attempts[sent++] = Attempt{ first, 0, false };
+
+    try {
+        attempts[0].sync = send(*first->client);
+    } catch (std::exception &) {
+        first->errors++;
+        throw;
+    }
+
+    // replies to the attempts but the winner's are dropped when they arrive,
+    // whichever way the function is left
+    struct DiscardAttempts {
+        Attempt *attempts;
+        size_t &sent;
+        const Attempt *winner;
+
+        ~DiscardAttempts()
+        {
+            for (size_t k = 0; k < sent; k++) {
+                if (&attempts[k] != winner && !attempts[k].failed) {
+                    attempts[k].m->conn->discard_reply(attempts[k].sync);
+                }
+            }
+        }
+    } discard{ attempts, sent, nullptr };
+
+    bool hedged = false;
+    try {
+        hedged = !first->conn->wait_reply(attempts[0].sync, delay_ms);
+    } catch (std::exception &) {
+        first->errors++;
+        throw;
+    }
+
+    if (hedged) {
+        try {
+            auto second = pick(false, first);
+            second->requests++;
+            second->hedged++;
+            attempts[sent++] = Attempt{ second, 0, false };
+            attempts[1].sync = send(*second->client);
+        } catch (std::exception &) {
+            // there's nothing to hedge to or the request couldn't be sent,
+            // the first one is still waited for
+            if (sent == 2) {
+                attempts[1].m->errors++;
+                attempts[1].failed = true;
+            }
+        }
+    }
+
+    Attempt *winner = nullptr;
+    while (winner == nullptr) {
+        struct pollfd pfds[2];
+        nfds_t nfds = 0;
+
+        for (size_t k = 0; k < sent && winner == nullptr; k++) {
+            auto &a = attempts[k];
+            if (a.failed) {
+                continue;
+            }
+            try {
+                // takes the replies which have already arrived
+                a.m->conn->poll_replies(0);
+            } catch (std::exception &) {
+                a.failed = true;
+                a.m->errors++;
+                continue;
+            }
+            if (a.m->conn->has_reply(a.sync)) {
+                winner = &a;
+            } else {
+                pfds[nfds].fd = a.m->conn->fd();
+                pfds[nfds].events = POLLIN;
+                pfds[nfds].revents = 0;
+                nfds++;
+            }
+        }
+
+        if (winner != nullptr) {
+            break;
+        }
+
+        if (nfds == 0) {
+            Rcpp::stop("all the hedged requests failed");
+        }
+
+        int wait = 100;
+        if (conn_options.timeout >= 0) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0) {
+                Rcpp::stop("request timed out after %g seconds", conn_options.timeout);
+            }
+            wait = static_cast<int>(std::min<long long>(left, wait));
+        }
+
+        if (poll(pfds, nfds, wait) == -1 && errno != EINTR) {
+            Rcpp::stop("poll() failed: %s", strerror(errno));
+        }
+
+        Rcpp::checkUserInterrupt();
+    }
+
+    discard.winner = winner;
+
+    if (winner != &attempts[0]) {
+        winner->m->hedge_wins++;
+    }
+
+    try {
+        SEXP result = receive(*winner->m->client, winner->sync);
+        record_latency(*winner->m, std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+        return (result);
+    } catch (...) {
+        winner->m->errors++;
+        throw;
+    }
+}
+
+// Requests to a single host of multi_select(). They are encoded on the main
+// thread, sent and parsed by a worker thread, which must not touch R API and
+// reports errors in the job itself.
+struct ShardJob {
+    TntStream *stream = nullptr;
+    TntStreamPtr requests;
+    std::vector<size_t> slots;
+    std::vector<uint64_t> syncs;
+    std::vector<TntReplyPtr> replies;
+    std::vector<msgpack::unpacked> data;
+    std::string error;
+    // time it took to run the requests, in seconds
+    double seconds = 0;
+};
+
+static void run_shard_job_impl(ShardJob &job)
+{
+    auto s = job.stream;
+    auto n = job.syncs.size();
+
+    if (s->write(s, TNT_SBUF_DATA(job.requests.get()), TNT_SBUF_SIZE(job.requests.get())) == -1 || tnt_flush(s) == -1) {
+        job.error = tnt_strerror(s);
+        return;
+    }
+    s->wrcnt += n - 1;
+
+    std::unordered_map<uint64_t, size_t> positions;
+    for (size_t k = 0; k < n; k++) {
+        positions[job.syncs[k]] = k;
+    }
+
+    job.replies.resize(n);
+    job.data.resize(n);
+
+    for (size_t k = 0; k < n; k++) {
+        auto reply = TntReplyPtr(tnt_reply_init(NULL));
+        if (!reply || s->read_reply(s, reply.get()) != 0) {
+            job.error = reply ? tnt_strerror(s) : "couldn't init tnt_reply object";
+            return;
+        }
+
+        auto it = positions.find(reply->sync);
+        if (it == positions.end()) {
+            job.error = "unexpected reply";
+            return;
+        }
+
+        if (reply->code == 0 && reply->data && reply->data_end) {
+            unpack_referenced(job.data[it->second], reply->data, reply->data_end - reply->data);
+        }
+        job.replies[it->second] = std::move(reply);
+    }
+}
+
+static void run_shard_job(ShardJob &job)
+{
+    auto started = std::chrono::steady_clock::now();
+
+    // exceptions must not escape the worker thread
+    try {
+        run_shard_job_impl(job);
+    } catch (std::exception &e) {
+        job.error = e.what();
+    }
+
+    job.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+}
+
+// Runs selects on several hosts at once: requests to each host are sent and
+// their replies parsed on a separate thread, the results are converted to
+// R objects when all of them are done. Each request is a list with 'host'
+// (position in the list of hosts the pool was created with), 'space', 'key'
+// and the same optional entries as params of select().
+SEXP TarantoolPool::multi_select(Rcpp::List requests)
+{
+    std::vector<ShardJob> jobs(hosts);
+    std::vector<Member *> picked(hosts, nullptr);
+    msgpack::sbuffer buff;
+
+    auto n = static_cast<size_t>(requests.size());
+    for (size_t i = 0; i < n; i++) {
+        Rcpp::List r = requests[i];
+
+        if (!r.containsElementNamed("host") || !r.containsElementNamed("space")) {
+            Rcpp::stop("request %d: missed mandatory entries 'host' and 'space'", static_cast<int>(i + 1));
+        }
+
+        auto host = Rcpp::as<int>(r["host"]) - 1;
+        if (host < 0 || static_cast<size_t>(host) >= hosts) {
+            Rcpp::stop("request %d: invalid host %d", static_cast<int>(i + 1), host + 1);
+        }
+
+        auto space_id = Rcpp::as<int>(resolve_space(r["space"]));
+        TntStreamPtr packed_key = pack_buffer(buff, r.containsElementNamed("key") ? SEXP(r["key"]) : R_NilValue);
+
+        uint32_t index = 0;
+        uint32_t limit = std::numeric_limits<uint32_t>::max();
+        uint32_t offset = 0;
+        int iterator = TNT_ITER_EQ;
+
+        get_select_params(r, index, limit, offset, iterator);
+
+        auto &job = jobs[host];
+        if (!job.requests) {
+            picked[host] = pick_host(host);
+            // late replies to hedged reads etc. would be the first ones the
+            // worker reads
+            picked[host]->conn->drain_replies();
+            job.stream = picked[host]->conn->stream.get();
+            job.requests = TntStreamPtr(tnt_buf(NULL));
+            if (!job.requests) {
+                Rcpp::stop("couldn't init tnt_buf object");
+            }
+        }
+
+        job.requests->reqid = job.stream->reqid;
+        job.syncs.push_back(job.requests->reqid);
+        job.slots.push_back(i);
+
+        auto rc = tnt_select(job.requests.get(), space_id, index, limit, offset, iterator, packed_key.get());
+        check_tnt_api_rc(rc, "tnt_select()");
+
+        job.stream->reqid = job.requests->reqid;
+    }
+
+    std::vector<std::thread> workers;
+    for (auto &job : jobs) {
+        if (!job.syncs.empty()) {
+            workers.emplace_back(run_shard_job, std::ref(job));
+        }
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+
+    Rcpp::List result(n);
+    std::string error;
+
+    for (size_t h = 0; h < hosts; h++) {
+        auto &job = jobs[h];
+        if (job.syncs.empty()) {
+            continue;
+        }
+
+        auto &m = *picked[h];
+        m.requests += job.syncs.size();
+        if (job.error.empty()) {
+            // the requests were pipelined, each of them took its share
+            record_latency(m, job.seconds / job.syncs.size());
+        }
+
+        if (!job.error.empty()) {
+            // replies may be left unread, the stream can't be used anymore
+            m.errors++;
+            m.reconnects++;
+            try {
+                m.conn->reconnect();
+            } catch (std::exception &) {
+            }
+            if (error.empty()) {
+                error = "host " + std::to_string(h + 1) + ": " + job.error;
+            }
+            continue;
+        }
+
+        for (size_t k = 0; k < job.syncs.size(); k++) {
+            auto &reply = job.replies[k];
+            if (reply->code != 0) {
+                m.errors++;
+                if (error.empty()) {
+                    error = "request " + std::to_string(job.slots[k] + 1) + " failed: " + reply_error_msg(reply.get());
+                }
+            } else if (reply->data && reply->data_end) {
+                result[job.slots[k]] = unpack_object(job.data[k].get());
+            }
+        }
+    }
+
+    if (!error.empty()) {
+        Rcpp::stop(error);
+    }
+
+    return (result);
+}
+
+SEXP TarantoolPool::stats()
+{
+    auto n = members.size();
+
+    Rcpp::CharacterVector host(n);
+    Rcpp::IntegerVector port(n);
+    Rcpp::LogicalVector leader(n);
+    Rcpp::LogicalVector connected(n);
+    Rcpp::NumericVector requests(n);
+    Rcpp::NumericVector errors(n);
+    Rcpp::NumericVector reconnects(n);
+    Rcpp::NumericVector latency(n);
+    Rcpp::IntegerVector pending(n);
+    Rcpp::NumericVector hedged(n);
+    Rcpp::NumericVector hedge_wins(n);
+
+    for (size_t i = 0; i < n; i++) {
+        const auto &m = members[i];
+        host[i] = m.host;
+        port[i] = m.port;
+        leader[i] = m.leader;
+        connected[i] = m.conn && !m.conn->broken();
+        requests[i] = m.requests;
+        errors[i] = m.errors;
+        reconnects[i] = m.reconnects;
+        latency[i] = m.latency;
+        pending[i] = m.conn ? m.conn->stream->wrcnt : 0;
+        hedged[i] = m.hedged;
+        hedge_wins[i] = m.hedge_wins;
+    }
+
+    return (Rcpp::DataFrame::create(Rcpp::Named("host") = host, Rcpp::Named("port") = port, Rcpp::Named("leader") = leader,
+        Rcpp::Named("connected") = connected, Rcpp::Named("requests") = requests, Rcpp::Named("errors") = errors,
+        Rcpp::Named("reconnects") = reconnects, Rcpp::Named("latency") = latency,
+        Rcpp::Named("pending") = pending, Rcpp::Named("hedged") = hedged,
+        Rcpp::Named("hedge_wins") = hedge_wins, Rcpp::Named("stringsAsFactors") = false));
+}
+
+static TarantoolReplica *make_replica(std::string host, int port, std::string user, std::string password, Rcpp::List options)
+{
+    return (new TarantoolReplica(std::make_shared<Connection>(host, port, user, password, ConnectionOptions::parse(options)), options));
 }
 
 RCPP_MODULE(Tarantool)
@@ -833,15 +3010,102 @@ RCPP_MODULE(Tarantool)
         .constructor("default constructor")
         .constructor<std::string, int>("constructor with host and port")
         .constructor<std::string, int, std::string, std::string>("constructor with host, port user and password")
+        .constructor<std::string, int, std::string, std::string, Rcpp::List>("constructor with host, port, user, password and options")
         .method("ping", &Tarantool::ping, "runs 'PING' command to test server state")
         .method("insert", &Tarantool::insert, "inserts data")
         .method("replace", &Tarantool::replace, "replaces data")
         .method("select", &Tarantool::select, "selects data")
+        .method("select_df", &Tarantool::select_df, "selects data into a data.frame")
+        .method("select_many", &Tarantool::select_many, "selects data by many keys into a data.frame")
+        .method("update_many", &Tarantool::update_many, "updates tuples with many keys using an operations template")
+        .method("upsert_many", &Tarantool::upsert_many, "upserts many tuples using an operations template")
         .method("delete", &Tarantool::delete_, "deletes data")
         .method("update", &Tarantool::update, "selects data")
         .method("upsert", &Tarantool::upsert, "upserts data")
         .method("call", &Tarantool::call, "call lua function")
-        .method("evaluate", &Tarantool::evaluate, "evaluate lua statement");
+        .method("evaluate", &Tarantool::evaluate, "evaluate lua statement")
+        .method("call_columns", &Tarantool::call_columns, "calls lua function returning columns into a data.frame")
+        .method("eval_columns", &Tarantool::eval_columns, "evaluates lua statement returning columns into a data.frame")
+        .method("insert_df", &Tarantool::insert_df, "inserts rows of a data.frame")
+        .method("replace_df", &Tarantool::replace_df, "replaces rows of a data.frame")
+        .method("async_insert", &Tarantool::async_insert, "sends insert request without waiting for reply")
+        .method("async_replace", &Tarantool::async_replace, "sends replace request without waiting for reply")
+        .method("async_select", &Tarantool::async_select, "sends select request without waiting for reply")
+        .method("async_delete", &Tarantool::async_delete, "sends delete request without waiting for reply")
+        .method("async_call", &Tarantool::async_call, "calls lua function without waiting for reply")
+        .method("async_evaluate", &Tarantool::async_evaluate, "evaluates lua statement without waiting for reply")
+        .method("poll", &Tarantool::poll, "waits for replies to asynchronous requests")
+        .method("scan", &Tarantool::scan, "creates cursor fetching data page by page")
+        .method("pipeline", &Tarantool::pipeline, "creates pipeline of requests")
+        .method("prepare_select", &Tarantool::prepare_select, "prepares select with fixed space, index, iterator and limit")
+        .method("prepare_update", &Tarantool::prepare_update, "prepares update with fixed fields and operators")
+        .method("execute", &Tarantool::execute, "executes SQL statement")
+        .method("prepare", &Tarantool::prepare, "prepares SQL statement on the server")
+        .method("enable_cache", &Tarantool::enable_cache, "enables cache of select replies with max entries and ttl")
+        .method("disable_cache", &Tarantool::disable_cache, "disables cache of select replies")
+        .method("set_cache_ttl", &Tarantool::set_cache_ttl, "sets ttl of the space's cached replies")
+        .method("cache_stats", &Tarantool::cache_stats, "cache hits, misses, evictions and entries")
+        .method("stats", &Tarantool::stats, "latency histograms, reply sizes, errors and traffic of the requests")
+        .method("reset_stats", &Tarantool::reset_stats, "reset request statistics")
+        .method("trim_arena", &Tarantool::trim_arena, "frees memory kept for reading replies")
+        .method("timeout", &Tarantool::timeout, "time in seconds the replies are waited for")
+        .method("set_timeout", &Tarantool::set_timeout, "sets time in seconds the replies are waited for");
+
+    Rcpp::class_<TarantoolPool>("TarantoolPool")
+        .constructor<Rcpp::CharacterVector, int>("constructor with hosts and number of connections per host")
+        .constructor<Rcpp::CharacterVector, int, Rcpp::List>("constructor with hosts, number of connections per host and options")
+        .method("select", &TarantoolPool::select, "selects data from a replica")
+        .method("select_df", &TarantoolPool::select_df, "selects data from a replica into a data.frame")
+        .method("insert", &TarantoolPool::insert, "inserts data")
+        .method("replace", &TarantoolPool::replace, "replaces data")
+        .method("delete", &TarantoolPool::delete_, "deletes data")
+        .method("update", &TarantoolPool::update, "updates data")
+        .method("upsert", &TarantoolPool::upsert, "upserts data")
+        .method("call", &TarantoolPool::call, "calls lua function on the leader")
+        .method("evaluate", &TarantoolPool::evaluate, "evaluates lua statement on the leader")
+        .method("read_call", &TarantoolPool::read_call, "calls read only lua function on a replica")
+        .method("multi_select", &TarantoolPool::multi_select, "runs selects on several hosts in parallel")
+        .method("stats", &TarantoolPool::stats, "statistics of the pool's connections");
+
+    Rcpp::class_<TarantoolFuture>("TarantoolFuture")
+        .method("ready", &TarantoolFuture::ready, "checks whether reply was received")
+        .method("value", &TarantoolFuture::value, "waits for reply and returns its data");
+
+    Rcpp::class_<TarantoolReply>("TarantoolReply")
+        .method("length", &TarantoolReply::length, "number of tuples")
+        .method("tuple", &TarantoolReply::tuple, "decodes the tuple with the given number")
+        .method("field", &TarantoolReply::field, "decodes the field with the given name or number of every tuple")
+        .method("as_data_frame", &TarantoolReply::as_data_frame, "decodes the whole reply into a data.frame")
+        .method("as_list", &TarantoolReply::as_list, "decodes the whole reply into a list");
+
+    Rcpp::class_<TarantoolScan>("TarantoolScan")
+        .method("next_chunk", &TarantoolScan::next_chunk, "fetches next page of data into a data.frame")
+        .method("done", &TarantoolScan::done, "checks whether all the data were fetched");
+
+    Rcpp::class_<TarantoolReplica>("TarantoolReplica")
+        .factory<std::string, int, std::string, std::string, Rcpp::List>(make_replica,
+            "subscribes to the replication stream of the server with host, port, user, password and options")
+        .method("fetch", &TarantoolReplica::fetch, "waits for data modification events and returns them as a data.frame")
+        .method("lsn", &TarantoolReplica::lsn, "lsn of the last received request");
+
+    Rcpp::class_<TarantoolPreparedSelect>("TarantoolPreparedSelect")
+        .method("exec", &TarantoolPreparedSelect::exec, "selects tuples matching the key");
+
+    Rcpp::class_<TarantoolPreparedUpdate>("TarantoolPreparedUpdate")
+        .method("exec", &TarantoolPreparedUpdate::exec, "updates tuple with the key using the arguments of operations");
+
+    Rcpp::class_<TarantoolPreparedSql>("TarantoolPreparedSql")
+        .method("exec", &TarantoolPreparedSql::exec, "executes the statement with the parameters")
+        .method("bind_count", &TarantoolPreparedSql::bind_count, "number of parameters of the statement")
+        .method("unprepare", &TarantoolPreparedSql::unprepare, "unprepares the statement unless other objects use it");
+
+    Rcpp::class_<TarantoolPipeline>("TarantoolPipeline")
+        .method("insert", &TarantoolPipeline::insert, "queues insert request")
+        .method("replace", &TarantoolPipeline::replace, "queues replace request")
+        .method("select", &TarantoolPipeline::select, "queues select request")
+        .method("call", &TarantoolPipeline::call, "queues call of lua function")
+        .method("size", &TarantoolPipeline::size, "number of queued requests")
+        .method("execute", &TarantoolPipeline::execute, "sends queued requests and reads replies");
 }
 
 // [[Rcpp::export]]
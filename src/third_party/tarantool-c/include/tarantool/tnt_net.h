@@ -79,6 +79,8 @@ struct tnt_stream_net {
 	char *greeting; /*!< Pointer to greeting, if connected */
 	struct tnt_schema *schema; /*!< Collation for space/index string<->number */
 	int inited; /*!< 1 if iob/schema were allocated */
+	uint64_t bytes_sent; /*!< Bytes written to the socket */
+	uint64_t bytes_received; /*!< Bytes read from the socket */
 };
 
 /*!
@@ -51,6 +51,7 @@
 #include <fcntl.h>
 #include <errno.h>
 
+#include <tarantool/tnt_mem.h>
 #include <tarantool/tnt_net.h>
 #include <tarantool/tnt_io.h>
 
@@ -337,6 +338,7 @@ tnt_io_send_raw(struct tnt_stream_net *s, const char *buf, size_t size, int all)
 			return -1;
 		}
 		off += r;
+		s->bytes_sent += r;
 	} while (off != size && all);
 	return off;
 }
@@ -360,6 +362,7 @@ tnt_io_sendv_raw(struct tnt_stream_net *s, struct iovec *iov, int count, int all
 			return -1;
 		}
 		total += r;
+		s->bytes_sent += r;
 		if (!all)
 			break;
 		while (count > 0) {
@@ -382,21 +385,15 @@ tnt_io_send(struct tnt_stream_net *s, const char *buf, size_t size)
 {
 	if (s->sbuf.buf == NULL)
 		return tnt_io_send_raw(s, buf, size, 1);
-	if (size > s->sbuf.size) {
-		s->error = TNT_EBIG;
-		return -1;
-	}
 	if ((s->sbuf.off + size) <= s->sbuf.size) {
 		memcpy(s->sbuf.buf + s->sbuf.off, buf, size);
 		s->sbuf.off += size;
 		return size;
 	}
-	ssize_t r = tnt_io_send_raw(s, s->sbuf.buf, s->sbuf.off, 1);
-	if (r == -1)
-		return -1;
-	s->sbuf.off = size;
-	memcpy(s->sbuf.buf, buf, size);
-	return size;
+	/* doesn't fit: send buffered data together with the new one
+	 * using a single writev() instead of copying it */
+	struct iovec iov = { (void *)buf, size };
+	return tnt_io_sendv(s, &iov, 1);
 }
 
 inline static void
@@ -419,19 +416,30 @@ tnt_io_sendv(struct tnt_stream_net *s, struct iovec *iov, int count)
 	int i;
 	for (i = 0 ; i < count ; i++)
 		size += iov[i].iov_len;
-	if (size > s->sbuf.size) {
-		s->error = TNT_EBIG;
-		return -1;
-	}
 	if ((s->sbuf.off + size) <= s->sbuf.size) {
 		tnt_io_sendv_put(s, iov, count);
 		return size;
 	}
-	ssize_t r = tnt_io_send_raw(s, s->sbuf.buf, s->sbuf.off, 1);
+	/* doesn't fit: flush buffered data and the new one
+	 * with a single writev() */
+	struct iovec stack_v[8];
+	struct iovec *v = stack_v;
+	if (count + 1 > (int)(sizeof(stack_v) / sizeof(stack_v[0]))) {
+		v = tnt_mem_alloc((count + 1) * sizeof(struct iovec));
+		if (v == NULL) {
+			s->error = TNT_EMEMORY;
+			return -1;
+		}
+	}
+	v[0].iov_base = s->sbuf.buf;
+	v[0].iov_len = s->sbuf.off;
+	memcpy(v + 1, iov, count * sizeof(struct iovec));
+	ssize_t r = tnt_io_sendv_raw(s, v, count + 1, 1);
+	if (v != stack_v)
+		tnt_mem_free(v);
 	if (r == -1)
 		return -1;
 	s->sbuf.off = 0;
-	tnt_io_sendv_put(s, iov, count);
 	return size;
 }
 
@@ -454,6 +462,7 @@ tnt_io_recv_raw(struct tnt_stream_net *s, char *buf, size_t size, int all)
 			return -1;
 		}
 		off += r;
+		s->bytes_received += r;
 	} while (off != size && all);
 	return off;
 }
@@ -479,6 +488,14 @@ tnt_io_recv(struct tnt_stream_net *s, char *buf, size_t size)
 		}
 
 		s->rbuf.off = 0;
+		s->rbuf.top = 0;
+		if (rv >= s->rbuf.size) {
+			/* large reply: read the rest of it straight into
+			 * the destination, no point in buffering */
+			if (tnt_io_recv_raw(s, buf + off, rv, 1) == -1)
+				return -1;
+			return size;
+		}
 		ssize_t top = tnt_io_recv_raw(s, s->rbuf.buf, s->rbuf.size, 0);
 		if (top <= 0) {
 			s->errno_ = errno;
@@ -193,8 +193,13 @@ tnt_reply_body0(struct tnt_reply *r, const char *buf, size_t size, size_t *off)
 			data_end = p;
 			break;
 		}
+		default:
+			/* keys of newer servers (SQL metadata etc.) */
+			mp_next(&p);
+			break;
 		}
-		bitmap |= (1ULL << key);
+		if (key < 64)
+			bitmap |= (1ULL << key);
 	}
 	if (r) {
 		r->error = error;
@@ -0,0 +1,550 @@
+// [[Rcpp::plugins(cpp11)]]
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <msgpuck.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "codec.h"
+#include "xlog.h"
+
+// Every block of rows starts with a marker followed by a fixed size header:
+// msgpack encoded length of the block, checksums of the previous and this
+// block and padding.
+static const size_t kFixHeaderSize = 19;
+static const size_t kMarkerSize = 4;
+static const unsigned char kRowMarker[kMarkerSize] = {0xd5, 0xba, 0x0b, 0xab};
+static const unsigned char kCompressedRowMarker[kMarkerSize] = {0xd5, 0xba, 0x0b, 0xba};
+static const unsigned char kEofMarker[kMarkerSize] = {0xd5, 0x10, 0xad, 0xed};
+
+// Keys of row's header and body maps.
+enum XrowKey : uint64_t {
+    kRequestType = 0x00,
+    kServerId = 0x02,
+    kLsn = 0x03,
+    kTimestamp = 0x04,
+    kSpaceId = 0x10,
+    kKey = 0x20,
+    kTuple = 0x21,
+    kOps = 0x28
+};
+
+enum XrowType : uint32_t { kInsert = 2, kReplace = 3, kUpdate = 4, kDelete = 5, kUpsert = 9, kNop = 12 };
+
+// Number of rows XrowFrameBuilder allocates its list columns for at first.
+static const R_xlen_t kInitialFrameCapacity = 1024;
+
+// Size decompressed blocks are allocated for at first, grown as needed.
+static const size_t kInitialInflatedSize = 64 * 1024;
+
+// Rows read between checks for user's interrupt.
+static const size_t kInterruptCheckRows = 100000;
+
+static bool reference_all(msgpack::type::object_type, std::size_t, void *)
+{
+    return (true);
+}
+
+static XrowField field_span(const char *begin, const char *end)
+{
+    XrowField field;
+    field.data = begin;
+    field.size = end - begin;
+
+    return (field);
+}
+
+static uint64_t decode_uint_value(const char **p, const char *what)
+{
+    if (mp_typeof(**p) != MP_UINT) {
+        Rcpp::stop("malformed row: %s is not an unsigned integer", what);
+    }
+
+    return (mp_decode_uint(p));
+}
+
+void decode_xrow(const char **data, const char *end, XrowRequest &row)
+{
+    row = XrowRequest();
+
+    const char *p = *data;
+    const char *check = p;
+    if (mp_typeof(*p) != MP_MAP || mp_check(&check, end) != 0) {
+        Rcpp::stop("malformed row header");
+    }
+
+    uint32_t size = mp_decode_map(&p);
+    for (uint32_t i = 0; i < size; i++) {
+        if (mp_typeof(*p) != MP_UINT) {
+            mp_next(&p);
+            mp_next(&p);
+            continue;
+        }
+        switch (mp_decode_uint(&p)) {
+        case kRequestType:
+            row.type = decode_uint_value(&p, "request type");
+            break;
+        case kServerId:
+            row.server_id = decode_uint_value(&p, "server id");
+            break;
+        case kLsn:
+            row.lsn = decode_uint_value(&p, "lsn");
+            break;
+        case kTimestamp:
+            if (mp_typeof(*p) == MP_DOUBLE) {
+                row.timestamp = mp_decode_double(&p);
+            } else if (mp_typeof(*p) == MP_FLOAT) {
+                row.timestamp = mp_decode_float(&p);
+            } else {
+                mp_next(&p);
+            }
+            break;
+        default:
+            mp_next(&p);
+            break;
+        }
+    }
+
+    // NOP rows (written in place of requests skipped by triggers etc.) have
+    // no body, the next row follows the header right away
+    if (p < end && row.type != kNop) {
+        check = p;
+        if (mp_typeof(*p) != MP_MAP || mp_check(&check, end) != 0) {
+            Rcpp::stop("malformed row body");
+        }
+
+        size = mp_decode_map(&p);
+        for (uint32_t i = 0; i < size; i++) {
+            if (mp_typeof(*p) != MP_UINT) {
+                mp_next(&p);
+                mp_next(&p);
+                continue;
+            }
+            uint64_t key = mp_decode_uint(&p);
+            const char *value = p;
+            mp_next(&p);
+            switch (key) {
+            case kSpaceId:
+                row.space_id = decode_uint_value(&value, "space id");
+                break;
+            case kKey:
+                row.key = field_span(value, p);
+                break;
+            case kTuple:
+                row.tuple = field_span(value, p);
+                break;
+            case kOps:
+                row.ops = field_span(value, p);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    if (row.type == kUpdate) {
+        // update requests carry their operations in the tuple field
+        std::swap(row.tuple, row.ops);
+    }
+
+    *data = p;
+}
+
+msgpack::object unpack_xrow_field(msgpack::zone &zone, const XrowField &field)
+{
+    if (field.empty()) {
+        return (msgpack::object());
+    }
+
+    std::size_t off = 0;
+    bool referenced = false;
+
+    return (msgpack::unpack(zone, field.data, field.size, off, referenced, reference_all, nullptr, msgpack::unpack_limit()));
+}
+
+std::string xrow_type_name(uint32_t type)
+{
+    switch (type) {
+    case kInsert:
+        return "INSERT";
+    case kReplace:
+        return "REPLACE";
+    case kUpdate:
+        return "UPDATE";
+    case kDelete:
+        return "DELETE";
+    case kUpsert:
+        return "UPSERT";
+    default:
+        return std::to_string(type);
+    }
+}
+
+void XrowFrameBuilder::add(const XrowRequest &row)
+{
+    R_xlen_t i = nrows();
+    if (i == keys.size()) {
+        R_xlen_t capacity = std::max<R_xlen_t>(i * 2, kInitialFrameCapacity);
+        keys = Rf_xlengthgets(keys, capacity);
+        tuples = Rf_xlengthgets(tuples, capacity);
+        ops = Rf_xlengthgets(ops, capacity);
+    }
+
+    lsns.push_back(static_cast<double>(row.lsn));
+    server_ids.push_back(row.server_id);
+    timestamps.push_back(row.timestamp);
+    types.push_back(row.type);
+    space_ids.push_back(row.space_id);
+
+    if (!row.key.empty()) {
+        keys[i] = unpack_object(unpack_xrow_field(zone, row.key));
+    }
+    if (!row.tuple.empty()) {
+        tuples[i] = unpack_object(unpack_xrow_field(zone, row.tuple));
+    }
+    if (!row.ops.empty()) {
+        ops[i] = unpack_object(unpack_xrow_field(zone, row.ops));
+    }
+
+    zone.clear();
+}
+
+SEXP XrowFrameBuilder::build()
+{
+    R_xlen_t n = nrows();
+
+    Rcpp::CharacterVector type_names(n);
+    for (R_xlen_t i = 0; i < n; i++) {
+        type_names[i] = xrow_type_name(types[i]);
+    }
+
+    Rcpp::NumericVector timestamp(timestamps.begin(), timestamps.end());
+    timestamp.attr("class") = Rcpp::CharacterVector::create("POSIXct", "POSIXt");
+
+    // built by hand, as data.frame() would spread list columns over several
+    Rcpp::List df = Rcpp::List::create(Rcpp::Named("lsn") = Rcpp::NumericVector(lsns.begin(), lsns.end()),
+        Rcpp::Named("server_id") = Rcpp::IntegerVector(server_ids.begin(), server_ids.end()), Rcpp::Named("timestamp") = timestamp,
+        Rcpp::Named("type") = type_names, Rcpp::Named("space_id") = Rcpp::IntegerVector(space_ids.begin(), space_ids.end()),
+        Rcpp::Named("key") = Rf_xlengthgets(keys, n), Rcpp::Named("tuple") = Rf_xlengthgets(tuples, n),
+        Rcpp::Named("ops") = Rf_xlengthgets(ops, n));
+    df.attr("row.names") = Rcpp::IntegerVector::create(NA_INTEGER, -static_cast<int>(n));
+    df.attr("class") = "data.frame";
+
+    return (df);
+}
+
+XlogFile::XlogFile(const std::string &path)
+    : path(path)
+{
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        Rcpp::stop("can't open %s: %s", path.c_str(), strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        int err = errno;
+        close(fd);
+        Rcpp::stop("can't read %s: %s", path.c_str(), st.st_size == 0 ? "empty file" : strerror(err));
+    }
+
+    length = st.st_size;
+    void *addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        int err = errno;
+        close(fd);
+        Rcpp::stop("can't map %s: %s", path.c_str(), strerror(err));
+    }
+
+    base = static_cast<char *>(addr);
+    madvise(base, length, MADV_SEQUENTIAL);
+
+    try {
+        read_meta();
+    } catch (...) {
+        munmap(base, length);
+        close(fd);
+        throw;
+    }
+}
+
+XlogFile::~XlogFile()
+{
+#ifdef HAVE_ZSTD
+    ZSTD_freeDCtx(zstd);
+#endif
+    munmap(base, length);
+    close(fd);
+}
+
+void XlogFile::read_meta()
+{
+    // "SNAP\n" or "XLOG\n", version and "Key: value" lines up to an empty one
+    std::vector<std::string> lines;
+
+    while (offset < length) {
+        const char *begin = base + offset;
+        const char *eol = static_cast<const char *>(std::memchr(begin, '\n', length - offset));
+        if (eol == nullptr) {
+            break;
+        }
+        offset = eol - base + 1;
+        if (eol == begin) {
+            break;
+        }
+        lines.emplace_back(begin, eol);
+    }
+
+    if (lines.size() < 2 || (lines[0] != "SNAP" && lines[0] != "XLOG")) {
+        Rcpp::stop("%s is neither a snapshot nor an xlog file", path.c_str());
+    }
+    if (lines[1] != "0.12" && lines[1] != "0.13") {
+        Rcpp::stop("%s: unsupported file format version %s", path.c_str(), lines[1].c_str());
+    }
+
+    type = lines[0];
+}
+
+bool XlogFile::next_block(const char **data, size_t *size)
+{
+    if (length - offset < kMarkerSize) {
+        // file which is still being written has no eof marker
+        return (false);
+    }
+
+    const char *marker = base + offset;
+    if (std::memcmp(marker, kEofMarker, kMarkerSize) == 0) {
+        return (false);
+    }
+    bool compressed = std::memcmp(marker, kCompressedRowMarker, kMarkerSize) == 0;
+    if (!compressed && std::memcmp(marker, kRowMarker, kMarkerSize) != 0) {
+        if (std::all_of(marker, marker + kMarkerSize, [](char c) { return c == 0; })) {
+            // preallocated space past the last written block
+            return (false);
+        }
+        Rcpp::stop("%s: unexpected data at offset %.0f", path.c_str(), static_cast<double>(offset));
+    }
+
+    if (length - offset < kFixHeaderSize) {
+        Rcpp::stop("%s: truncated block at offset %.0f", path.c_str(), static_cast<double>(offset));
+    }
+
+    const char *header = marker + kMarkerSize;
+    const char *check = header;
+    if (mp_typeof(*header) != MP_UINT || mp_check(&check, base + offset + kFixHeaderSize) != 0) {
+        Rcpp::stop("%s: malformed block header at offset %.0f", path.c_str(), static_cast<double>(offset));
+    }
+
+    uint64_t len = mp_decode_uint(&header);
+    if (len > length - offset - kFixHeaderSize) {
+        Rcpp::stop("%s: truncated block at offset %.0f", path.c_str(), static_cast<double>(offset));
+    }
+
+    *data = base + offset + kFixHeaderSize;
+    *size = len;
+    if (compressed) {
+        *data = decompress(*data, len, size);
+    }
+    offset += kFixHeaderSize + len;
+
+    return (true);
+}
+
+// A compressed block is a single zstd frame, whose content size isn't
+// known upfront, so it's decompressed as a stream.
+const char *XlogFile::decompress(const char *src, size_t len, size_t *size)
+{
+#ifdef HAVE_ZSTD
+    if (zstd == nullptr) {
+        zstd = ZSTD_createDCtx();
+        if (zstd == nullptr) {
+            Rcpp::stop("%s: can't create zstd decompression context", path.c_str());
+        }
+    }
+    ZSTD_initDStream(zstd);
+
+    if (inflated.size() < std::max(kInitialInflatedSize, len * 4)) {
+        inflated.resize(std::max(kInitialInflatedSize, len * 4));
+    }
+
+    ZSTD_inBuffer in = { src, len, 0 };
+    size_t out_size = 0;
+    size_t rc = 1;
+    while (rc != 0) {
+        if (out_size == inflated.size()) {
+            inflated.resize(inflated.size() * 2);
+        }
+
+        ZSTD_outBuffer out = { inflated.data() + out_size, inflated.size() - out_size, 0 };
+        rc = ZSTD_decompressStream(zstd, &out, &in);
+        if (ZSTD_isError(rc)) {
+            Rcpp::stop("%s: can't decompress block at offset %.0f: %s", path.c_str(), static_cast<double>(offset),
+                ZSTD_getErrorName(rc));
+        }
+        out_size += out.pos;
+
+        if (rc != 0 && in.pos == in.size && out.pos < out.size) {
+            Rcpp::stop("%s: truncated compressed block at offset %.0f", path.c_str(), static_cast<double>(offset));
+        }
+    }
+
+    *size = out_size;
+
+    return (inflated.data());
+#else
+    (void)src;
+    (void)len;
+    (void)size;
+    Rcpp::stop("%s: block at offset %.0f is zstd compressed, which requires tarantoolr built with libzstd", path.c_str(),
+        static_cast<double>(offset));
+#endif
+}
+
+static std::vector<std::string> list_xlogs(const std::string &dir)
+{
+    // xlogs are named by the lsn they start with, zero padded to the same
+    // width, so sorting the names orders the files by lsn
+    Rcpp::Function list_files("list.files");
+    Rcpp::CharacterVector files = list_files(dir, Rcpp::Named("pattern") = "\\.xlog$", Rcpp::Named("full.names") = true);
+
+    auto paths = Rcpp::as<std::vector<std::string>>(files);
+    std::sort(paths.begin(), paths.end());
+
+    return (paths);
+}
+
+static uint64_t xlog_start_lsn(const std::string &path)
+{
+    auto slash = path.find_last_of('/');
+    std::string name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+
+    return (std::strtoull(name.c_str(), nullptr, 10));
+}
+
+// Whether the package was built with libzstd, so that compressed blocks of
+// snapshots and xlogs can be read.
+// [[Rcpp::export]]
+bool xlog_zstd_supported()
+{
+#ifdef HAVE_ZSTD
+    return (true);
+#else
+    return (false);
+#endif
+}
+
+// Reads tuples of a snapshot into a data.frame per space. `space_filter` is
+// a vector of space ids, NULL stands for all spaces, system ones included.
+// [[Rcpp::export]]
+Rcpp::List read_snapshot(std::string path, SEXP space_filter)
+{
+    std::unordered_set<uint32_t> spaces;
+    std::map<uint32_t, DataFrameBuilder> frames;
+
+    if (!Rf_isNull(space_filter)) {
+        for (int id : Rcpp::as<Rcpp::IntegerVector>(space_filter)) {
+            if (id == NA_INTEGER || id < 0) {
+                Rcpp::stop("invalid space id in space_filter");
+            }
+            spaces.insert(id);
+            // requested spaces are returned even if they happen to be empty
+            frames[id];
+        }
+    }
+
+    XlogFile file(path);
+    if (file.filetype() != "SNAP") {
+        Rcpp::stop("%s is not a snapshot", path.c_str());
+    }
+
+    msgpack::zone zone;
+    XrowRequest row;
+    const char *data = nullptr;
+    size_t size = 0;
+    size_t nrows = 0;
+
+    while (file.next_block(&data, &size)) {
+        const char *end = data + size;
+        while (data < end) {
+            decode_xrow(&data, end, row);
+            if ((spaces.empty() || spaces.count(row.space_id) > 0) && !row.tuple.empty()) {
+                frames[row.space_id].add_tuple(unpack_xrow_field(zone, row.tuple));
+                zone.clear();
+            }
+            if (++nrows % kInterruptCheckRows == 0) {
+                Rcpp::checkUserInterrupt();
+            }
+        }
+    }
+
+    Rcpp::List result(frames.size());
+    Rcpp::CharacterVector names(frames.size());
+    R_xlen_t i = 0;
+    for (auto &frame : frames) {
+        result[i] = frame.second.build();
+        names[i] = std::to_string(frame.first);
+        i++;
+    }
+    result.attr("names") = names;
+
+    return (result);
+}
+
+// Reads requests with lsn not less than `from_lsn` from the xlogs in `dir`
+// into a data.frame with a row per request.
+// [[Rcpp::export]]
+SEXP read_xlog(std::string dir, double from_lsn)
+{
+    auto paths = list_xlogs(dir);
+
+    // skip the files which end before from_lsn, the last of those that start
+    // at or before it may still contain the requested rows
+    size_t first = 0;
+    for (size_t i = 1; i < paths.size(); i++) {
+        if (static_cast<double>(xlog_start_lsn(paths[i])) <= from_lsn) {
+            first = i;
+        }
+    }
+
+    XrowFrameBuilder frame;
+    XrowRequest row;
+
+    for (size_t i = first; i < paths.size(); i++) {
+        XlogFile file(paths[i]);
+        if (file.filetype() != "XLOG") {
+            Rcpp::stop("%s is not an xlog", paths[i].c_str());
+        }
+
+        const char *data = nullptr;
+        size_t size = 0;
+        while (file.next_block(&data, &size)) {
+            const char *end = data + size;
+            while (data < end) {
+                decode_xrow(&data, end, row);
+                if (static_cast<double>(row.lsn) >= from_lsn) {
+                    frame.add(row);
+                    if (frame.nrows() % kInterruptCheckRows == 0) {
+                        Rcpp::checkUserInterrupt();
+                    }
+                }
+            }
+        }
+    }
+
+    return (frame.build());
+}
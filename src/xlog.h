@@ -0,0 +1,126 @@
+#ifndef TARANTOOLR_XLOG_H
+#define TARANTOOLR_XLOG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Rcpp.h>
+
+#include <msgpack.hpp>
+
+// ZSTD_DCtx, see zstd.h.
+struct ZSTD_DCtx_s;
+
+// Reading of Tarantool's snapshot (.snap) and write ahead log (.xlog) files
+// without a running server. Both share the same format: a text header
+// followed by blocks of rows, each row being a msgpack encoded request.
+// Tarantool compresses the blocks larger than a couple of kilobytes with
+// zstd, those are only read if the package is built with libzstd (see
+// xlog_zstd_supported()).
+
+// Raw msgpack value of a row's field, pointing into the buffer the row was
+// decoded from.
+struct XrowField {
+    const char *data = nullptr;
+    size_t size = 0;
+
+    bool empty() const
+    {
+        return (data == nullptr);
+    }
+};
+
+// A data modification request as it is stored in snapshots and xlogs and sent
+// by the server over replication. Key, tuple and update operations are kept
+// encoded, so that rows which aren't needed cost next to nothing to skip.
+struct XrowRequest {
+    uint32_t type = 0;
+    uint32_t server_id = 0;
+    uint64_t lsn = 0;
+    double timestamp = 0;
+    uint32_t space_id = 0;
+    XrowField key;
+    XrowField tuple;
+    XrowField ops;
+};
+
+// Decodes a row (its header and body maps) starting at `*data` and moves
+// `*data` past it.
+void decode_xrow(const char **data, const char *end, XrowRequest &row);
+
+// Unpacks a field of a row into `zone`, strings and binaries referencing the
+// buffer the row was decoded from. Missing fields are returned as nils.
+msgpack::object unpack_xrow_field(msgpack::zone &zone, const XrowField &field);
+
+// Name of a request type as used in xlogs, e.g. "INSERT" or "UPDATE".
+std::string xrow_type_name(uint32_t type);
+
+// Collects requests into a data.frame with a row per request: lsn, server id,
+// timestamp, request type, space id and key, tuple and update operations as
+// list columns (NULL where request has none).
+class XrowFrameBuilder
+{
+public:
+    // Converts fields of the request to R objects right away, so the buffer
+    // it was decoded from may go once add() returns.
+    void add(const XrowRequest &row);
+
+    R_xlen_t nrows() const
+    {
+        return (lsns.size());
+    }
+
+    SEXP build();
+
+private:
+    std::vector<double> lsns;
+    std::vector<int> server_ids;
+    std::vector<double> timestamps;
+    std::vector<uint32_t> types;
+    std::vector<int> space_ids;
+    Rcpp::List keys;
+    Rcpp::List tuples;
+    Rcpp::List ops;
+    msgpack::zone zone;
+};
+
+// Snapshot or xlog file mapped into memory.
+class XlogFile
+{
+public:
+    explicit XlogFile(const std::string &path);
+    ~XlogFile();
+
+    XlogFile(const XlogFile &) = delete;
+    XlogFile &operator=(const XlogFile &) = delete;
+
+    // "SNAP" or "XLOG"
+    const std::string &filetype() const
+    {
+        return (type);
+    }
+
+    // Points `data` and `size` at the rows of the next block, decompressing
+    // it if it's zstd compressed (the data then stays valid until the next
+    // call). Checksums of the blocks aren't verified. Returns false at the end
+    // of file.
+    bool next_block(const char **data, size_t *size);
+
+private:
+    void read_meta();
+    const char *decompress(const char *src, size_t len, size_t *size);
+
+    std::string path;
+    std::string type;
+    int fd = -1;
+    char *base = nullptr;
+    size_t length = 0;
+    size_t offset = 0;
+
+    // decompressed data of the last compressed block
+    std::vector<char> inflated;
+    ZSTD_DCtx_s *zstd = nullptr;
+};
+
+#endif
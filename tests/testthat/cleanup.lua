@@ -10,3 +10,21 @@ if box.schema.func.exists('add_two_numbers') then
     box.schema.user.revoke('guest', 'execute', 'function', 'add_two_numbers')
     box.schema.func.drop('add_two_numbers')
 end
+
+if box.schema.func.exists('slow_once') then
+    box.schema.func.drop('slow_once')
+end
+
+if box.schema.func.exists('sum_columns') then
+    box.schema.func.drop('sum_columns')
+end
+
+if box.space.SQL_TEST then
+    box.space.SQL_TEST:drop()
+end
+
+if box.space.persistent then
+    box.space.persistent:drop()
+end
+
+pcall(box.schema.user.revoke, 'guest', 'replication')
@@ -11,3 +11,8 @@ end
 
 box.schema.func.create('add_two_numbers')
 box.schema.user.grant('guest', 'execute', 'function', 'add_two_numbers')
+
+box.schema.space.create("persistent")
+box.space.persistent:create_index('primary', { type = 'tree', parts = { 1, 'num' }})
+
+box.schema.user.grant('guest', 'replication')
@@ -0,0 +1,5 @@
+box.execute([[CREATE TABLE sql_test (id INTEGER PRIMARY KEY AUTOINCREMENT, name STRING, value DOUBLE, flag BOOLEAN)]])
+box.execute([[INSERT INTO sql_test (name, value, flag) VALUES ('a', 1.5, true), ('b', 2.5, false), ('c', NULL, NULL)]])
+
+box.schema.user.grant('guest', 'read,write', 'space', 'SQL_TEST')
+box.schema.user.grant('guest', 'read,write', 'sequence', 'SQL_TEST')